@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <stdalign.h>
+#include <limits.h>
 #include <gsl/gsl_statistics_double.h>
 #include "TaskSegRaw.h"
 
@@ -33,6 +35,8 @@ static void TaskSegRaw_deinit(Object *objp);
 static void TaskSegRaw_export(TaskSeg *tsp, FILE *fp, TSTaskType tt);
 static TaskSeg_reql* TaskSegRaw_to_reql(TaskSeg *tsp, char sort);
 static TaskSeg_summary TaskSegRaw_eval(TaskSeg *tsp);
+static void TaskSegRawCtx_deinit(Object *objp);
+static void _pool_release(TSRPool *poolp, void *view, size_t len);
 
 const TaskSeg_VMT TaskSegRaw_vmt = {
     ._super._super._object_deinit = TaskSegRaw_deinit,
@@ -45,9 +49,11 @@ const TaskSeg_VMT TaskSegRaw_vmt = {
 };
 
 const TaskSegCtx_VMT TaskSegRawCtx_vmt = {
-    ._super._super._object_deinit = _TaskSegCtx_deinit,
+    ._super._super._object_deinit = TaskSegRawCtx_deinit,
 };
 
+#define TSR_POOL_HDR_SIZ    alignof(max_align_t)
+
 typedef struct __attribute__((__packed__)) {
     uint8_t type;
     double weight;
@@ -76,13 +82,6 @@ static inline unsigned task_curr_tot(const TaskSegRaw *ctx)
     return ac;
 }
 
-static inline unsigned task_lsiz_tot(const TaskSegRaw *ctx)
-{
-    unsigned ac = 0;
-    for (unsigned i = 0; i < TSTT_enumsize; i++) ac += ctx->treq_l[i].req_l_siz;
-    return ac;
-}
-
 
 static int sort_cf(const void *a, const void *b)
 {
@@ -161,14 +160,27 @@ static void TaskSegRaw_deinit(Object *objp)
 {
     TaskSegRaw *tsrp = (TaskSegRaw*)objp;
 
+    /* the task lists go back to the pools of the context */
     if (tsrp) {
+        TaskSegRawCtx *ctx = (TaskSegRawCtx*)((Elem*)tsrp)->ctxp;
         for (int i = 0; i < TSTT_enumsize; i++) {
-            free(tsrp->treq_l[i].req_l);
+            if (ctx)
+                _pool_release(
+                    &ctx->req_pool[i],
+                    tsrp->treq_l[i].req_l,
+                    (size_t)tsrp->treq_l[i].req_l_siz *
+                        sizeof(*tsrp->treq_l[i].req_l));
             tsrp->treq_l[i].req_l = NULL;
+            tsrp->treq_l[i].req_l_siz = 0;
         }
 
-        free(tsrp->task_type_l);
+        if (ctx)
+            _pool_release(
+                &ctx->type_pool,
+                tsrp->task_type_l,
+                (size_t)tsrp->task_type_l_siz * sizeof(*tsrp->task_type_l));
         tsrp->task_type_l = NULL;
+        tsrp->task_type_l_siz = 0;
     }
 
     _TaskSeg_deinit(objp);
@@ -204,8 +216,9 @@ static TaskSeg_reql* TaskSegRaw_to_reql(TaskSeg *tsp, char sort)
         reqp->reql[i] = malloc(creqp->task_cnt * sizeof(*creqp->req_l));
         if (!reqp->reql[i]) goto tsr_to_reql_err;
         reqp->reql_siz[i] = creqp->task_cnt;
-        memcpy(reqp->reql[i], creqp->req_l,
-            sizeof(*creqp->req_l) * reqp->reql_siz[i]);
+        if (reqp->reql_siz[i])
+            memcpy(reqp->reql[i], creqp->req_l,
+                sizeof(*creqp->req_l) * reqp->reql_siz[i]);
 
         if (sort)
             qsort(reqp->reql[i], reqp->reql_siz[i], sizeof(*reqp->reql[i]), sort_cf);
@@ -236,21 +249,8 @@ int TaskSegRaw_init(TaskSegRawCtx *ctx, TaskSegRaw *nseg)
 
     _obj_vmtp(nseg) = (Object_VMT*)&TaskSegRaw_vmt;
 
-    for (int i = 0 ; i < TSTT_enumsize; i++) {
-        nseg->treq_l[i].req_l =
-            malloc(TSR_MALLOC_CNT * sizeof(*nseg->treq_l[i].req_l));
-        nseg->treq_l[i].req_l_siz = TSR_MALLOC_CNT;
-
-        if (!nseg->treq_l[i].req_l) goto tsr_init_fail;
-    }
-
-    nseg->task_type_l = malloc(sizeof(*nseg->task_type_l) * TSR_MALLOC_CNT * 2);
-    assert(nseg->task_type_l);
+    /* the task lists are taken from the pools of the context by TSR_put() */
     return 0;
-
-tsr_init_fail:
-    assert(0);
-    return -1;
 }
 
 int TaskSegRawCtx_init(TaskSegRawCtx *ctx, double mu_max, double sigma_max)
@@ -261,7 +261,152 @@ int TaskSegRawCtx_init(TaskSegRawCtx *ctx, double mu_max, double sigma_max)
     ctx->_super.tsclass_id = TSR_CLASSID;
     ctx->compopt.mu_max = mu_max;
     ctx->compopt.sigma_max = sigma_max;
+    _obj_vmtp(ctx) = (Object_VMT*)&TaskSegRawCtx_vmt;
+
+    return 0;
+}
+
+static void _pool_free(TSRPool *poolp)
+{
+    while (poolp->chunk_l) {
+        void *next = *(void**)poolp->chunk_l;
+        free(poolp->chunk_l);
+        poolp->chunk_l = next;
+    }
+    poolp->cur = poolp->end = NULL;
+    memset(poolp->free_l, 0, sizeof(poolp->free_l));
+}
+
+static void TaskSegRawCtx_deinit(Object *objp)
+{
+    TaskSegRawCtx *ctx = (TaskSegRawCtx*)objp;
+
+    /* the segments first, as their lists are in the pools */
+    _TaskSegCtx_deinit(objp);
+    for (int i = 0; i < TSTT_enumsize; i++) _pool_free(&ctx->req_pool[i]);
+    _pool_free(&ctx->type_pool);
+}
+
+/* Move the chunks of pool 'from' behind the current chunk of 'to' */
+static void _pool_absorb(TSRPool *to, TSRPool *from)
+{
+    if (!from->chunk_l) return;
+
+    void **lastpp = from->chunk_l;
+    while (*lastpp) lastpp = *lastpp;
+    if (to->chunk_l) {
+        *lastpp = *(void**)to->chunk_l;
+        *(void**)to->chunk_l = from->chunk_l;
+    } else {
+        to->chunk_l = from->chunk_l;
+        to->cur = from->cur;
+        to->end = from->end;
+    }
+
+    from->chunk_l = NULL;
+    from->cur = from->end = NULL;
+
+    /* the released lists lie in the chunks moved */
+    for (unsigned c = 0; c < TSR_POOL_CLASSES; c++) {
+        if (!from->free_l[c]) continue;
+        void *last = from->free_l[c], *next;
+        while (memcpy(&next, last, sizeof(next)), next) last = next;
+        memcpy(last, &to->free_l[c], sizeof(last));
+        to->free_l[c] = from->free_l[c];
+        from->free_l[c] = NULL;
+    }
+}
+
+/* Hand the pools of a context over to another one, e.g. once its segments
+ * were moved there with Elem_move_ctx(). The task lists stay where they are.
+ * The segments left in 'from' can still be read, but must not outlive 'to'.
+ * @param to pointer to the context taking over the pools
+ * @param from pointer to the context whose pools are emptied */
+void TaskSegRawCtx_absorb(TaskSegRawCtx *to, TaskSegRawCtx *from)
+{
+    assert(to && from);
+    for (int i = 0; i < TSTT_enumsize; i++)
+        _pool_absorb(&to->req_pool[i], &from->req_pool[i]);
+    _pool_absorb(&to->type_pool, &from->type_pool);
+}
+
+/* Take back a list of 'len' bytes of a pool. The list at the end of the
+ * pool is given back to the free space of its chunk, any other one is kept
+ * for reuse by _pool_grow(), in the class of the largest power of two it
+ * holds. The lists are linked through their first bytes, which may be
+ * unaligned: lists too short for the link are left as they are.
+ * @param poolp pointer to the pool
+ * @param view the list, can be NULL
+ * @param len size of the list in bytes */
+static void _pool_release(TSRPool *poolp, void *view, size_t len)
+{
+    /* no chunks: they were handed over, see TaskSegRawCtx_absorb() */
+    if (!view || !poolp->chunk_l) return;
+    if ((char*)view + len == poolp->cur) {
+        poolp->cur = view;
+        return;
+    }
+    if (len < sizeof(void*)) return;
 
+    unsigned c = 63 - __builtin_clzll(len);
+    if (c >= TSR_POOL_CLASSES) return;
+    memcpy(view, &poolp->free_l[c], sizeof(void*));
+    poolp->free_l[c] = view;
+}
+
+/* Make room for one more object in a list of 'cnt' objects of size 'siz',
+ * viewed at '*viewp' with capacity '*capp'. The list at the end of the pool
+ * grows in place, any other one is moved to a list of twice the capacity:
+ * a released one if any is large enough, the end of the pool otherwise.
+ * @return 0 on success, -1 on memory allocation failure */
+static int _pool_grow(
+    TSRPool *poolp,
+    void **viewp,
+    unsigned *capp,
+    unsigned cnt,
+    size_t siz)
+{
+    char *view = *viewp;
+    if (view &&
+        view + (size_t)*capp * siz == poolp->cur &&
+        (size_t)(poolp->end - poolp->cur) >= siz) {
+        poolp->cur += siz;
+        (*capp)++;
+        return 0;
+    }
+
+    unsigned cap = cnt ? cnt * 2 : 1;
+    size_t len = (size_t)cap * siz;
+
+    /* the smallest class whose lists all hold 'len' bytes */
+    unsigned c = len > 1 ? 64 - __builtin_clzll(len - 1) : 0;
+    if (c < TSR_POOL_CLASSES && poolp->free_l[c] &&
+        ((size_t)1 << c) / siz <= UINT_MAX) {
+        char *nview = poolp->free_l[c];
+        memcpy(&poolp->free_l[c], nview, sizeof(void*));
+        if (cnt) memcpy(nview, view, (size_t)cnt * siz);
+        _pool_release(poolp, view, (size_t)*capp * siz);
+        *viewp = nview;
+        *capp = ((size_t)1 << c) / siz;
+        return 0;
+    }
+
+    if ((size_t)(poolp->end - poolp->cur) < len) {
+        size_t chunk_siz = len > TSR_POOL_CHUNK ? len : TSR_POOL_CHUNK;
+        char *chunk = malloc(TSR_POOL_HDR_SIZ + chunk_siz);
+        if (!chunk) return -1;
+        *(void**)chunk = poolp->chunk_l;
+        poolp->chunk_l = chunk;
+        poolp->cur = chunk + TSR_POOL_HDR_SIZ;
+        poolp->end = poolp->cur + chunk_siz;
+    }
+
+    char *nview = poolp->cur;
+    poolp->cur += len;
+    if (cnt) memcpy(nview, view, (size_t)cnt * siz);
+    _pool_release(poolp, view, (size_t)*capp * siz);
+    *viewp = nview;
+    *capp = cap;
     return 0;
 }
 
@@ -274,32 +419,30 @@ TSRRes TSR_put(TaskSegRaw *tsrp, TSRTask task)
 {
     assert(tsrp);
     assert((unsigned)task.type < TSTT_enumsize);
+    TaskSegRawCtx *ctx = (TaskSegRawCtx*)((Elem*)tsrp)->ctxp;
     TReql *rqlp = &tsrp->treq_l[task.type];
-
-    if (rqlp->task_cnt == rqlp->req_l_siz) {
-        double *nfp = realloc(
-            rqlp->req_l,
-            rqlp->req_l_siz * sizeof(*nfp) * 2);
-
-        if (!nfp) return TSR_mem;
-        rqlp->req_l         = nfp;
-        rqlp->req_l_siz     *= 2;
-
-        TSTaskType *nttp = realloc(
-            tsrp->task_type_l,
-            task_lsiz_tot(tsrp) * sizeof(*nttp));
-
-        if (!nttp) {
-            /* The newly allocated list may stay as it is, although advertised
-             * to be half the size.*/
-            rqlp->req_l_siz /= 2;
-            return TSR_mem;
-        }
-        tsrp->task_type_l = nttp;
-    }
-
-    tsrp->task_type_l[task_cnt_tot(tsrp)]   = task.type;
-    rqlp->req_l[rqlp->task_cnt++]           = task.req;
+    unsigned tcnt = task_cnt_tot(tsrp);
+
+    if (rqlp->task_cnt == rqlp->req_l_siz &&
+        _pool_grow(
+            &ctx->req_pool[task.type],
+            (void**)&rqlp->req_l,
+            &rqlp->req_l_siz,
+            rqlp->task_cnt,
+            sizeof(*rqlp->req_l)))
+        return TSR_mem;
+
+    if (tcnt == tsrp->task_type_l_siz &&
+        _pool_grow(
+            &ctx->type_pool,
+            (void**)&tsrp->task_type_l,
+            &tsrp->task_type_l_siz,
+            tcnt,
+            sizeof(*tsrp->task_type_l)))
+        return TSR_mem;
+
+    tsrp->task_type_l[tcnt]         = task.type;
+    rqlp->req_l[rqlp->task_cnt++]   = task.req;
 
     return TSR_ok;
 }
@@ -358,11 +501,52 @@ void TSR_eval(TaskSegRaw *tsrp)
         creqp->stddev = creqp->task_cnt > 1 ?
             gsl_stats_sd_m(creqp->req_l, 1, creqp->task_cnt, creqp->avg) : 0.0;
         creqp->sum = 0;
-        for (unsigned j = 0; j < creqp->req_l_siz; j++)
+        for (unsigned j = 0; j < creqp->task_cnt; j++)
             creqp->sum += creqp->req_l[j];
     }
 }
 
+/* @return hash of the task types and weights of a segment, equal for the
+ * segments found equal by TSR_equal()
+ * @param tsrp pointer to the task segment */
+uint64_t TSR_hash(const TaskSegRaw *tsrp)
+{
+    assert(tsrp);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    unsigned tcnt = task_cnt_tot(tsrp);
+
+    /* FNV-1a over the types and the bits of the weights */
+    for (unsigned i = 0; i < tcnt; i++)
+        h = (h ^ tsrp->task_type_l[i]) * 0x100000001b3ULL;
+    for (int i = 0; i < TSTT_enumsize; i++) {
+        for (unsigned j = 0; j < tsrp->treq_l[i].task_cnt; j++) {
+            uint64_t bits;
+            memcpy(&bits, &tsrp->treq_l[i].req_l[j], sizeof(bits));
+            h = (h ^ bits) * 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
+
+/* Check if two segments hold the same tasks, with the very same weights.
+ * Unlike TaskSeg_compar(), no tolerance applies.
+ * @return 1 if equal, 0 otherwise */
+int TSR_equal(const TaskSegRaw *tsr1p, const TaskSegRaw *tsr2p)
+{
+    assert(tsr1p && tsr2p);
+    for (int i = 0; i < TSTT_enumsize; i++) {
+        unsigned cnt = tsr1p->treq_l[i].task_cnt;
+        if (cnt != tsr2p->treq_l[i].task_cnt) return 0;
+        if (cnt && memcmp(tsr1p->treq_l[i].req_l, tsr2p->treq_l[i].req_l,
+                cnt * sizeof(*tsr1p->treq_l[i].req_l)))
+            return 0;
+    }
+
+    unsigned tcnt = task_cnt_tot(tsr1p);
+    return !tcnt || !memcmp(tsr1p->task_type_l, tsr2p->task_type_l,
+        tcnt * sizeof(*tsr1p->task_type_l));
+}
+
 /* Merge two segments by concatenation.
  * @param tsegp1 pointer to the destination segment to be extended
  * @param tsegp1 pointer to the source segment
@@ -23,8 +23,9 @@
 #include <stdint.h>
 #include "TaskSeg.h"
 
-#define TSR_MALLOC_CNT     16
 #define TSR_CLASSID 0x1
+/* size of the chunks of the weight pools, in bytes */
+#define TSR_POOL_CHUNK  (1 << 19)
 
 typedef enum {
     TSR_ok,
@@ -37,8 +38,27 @@ typedef struct {
     TSTaskType type;
 } TSRTask;
 
+/* number of size classes of the released lists of a pool */
+#define TSR_POOL_CLASSES 48
+
+/* Storage for the task lists of the segments of a context. The lists are
+ * views into chunks of the pool. The lists released by their segments are
+ * taken back for reuse, the chunks are released with the context. */
+typedef struct {
+    /* chunks, linked through their first bytes */
+    void        *chunk_l;
+    /* free space of the current chunk */
+    char        *cur;
+    char        *end;
+    /* released lists of at least 2^i bytes, linked through their first
+     * bytes */
+    void        *free_l[TSR_POOL_CLASSES];
+} TSRPool;
+
 typedef struct TReql {
+    /* view into the weight pool of the type */
     double      *req_l;
+    /* capacity of the view */
     unsigned    req_l_siz;
     unsigned    task_cnt;
     unsigned    task_curr;
@@ -49,7 +69,9 @@ typedef struct TReql {
 
 typedef struct {
     TaskSeg             _super;
+    /* view into the task type pool, and its capacity */
     TSTaskType          *task_type_l;
+    unsigned            task_type_l_siz;
     TReql               treq_l[TSTT_enumsize];
     TSRTask             ct;
 } TaskSegRaw;
@@ -62,17 +84,24 @@ typedef struct {
 typedef struct {
     TaskSegCtx  _super;
     TSR_compopt compopt;
+    /* weights of the segments, by task type */
+    TSRPool     req_pool[TSTT_enumsize];
+    /* task types of the segments */
+    TSRPool     type_pool;
 } TaskSegRawCtx;
 
 extern const TaskSeg_VMT TaskSegRaw_vmt;
 
 int             TaskSegRaw_init(TaskSegRawCtx *ctx, TaskSegRaw *tsrp);
 int             TaskSegRawCtx_init(TaskSegRawCtx *ctx, double mu_max, double sigma_max);
+void            TaskSegRawCtx_absorb(TaskSegRawCtx *to, TaskSegRawCtx *from);
 TSRRes          TSR_put(TaskSegRaw *tsrp, TSRTask taskp);
 const TSRTask*  TSR_next(TaskSegRaw *tsrp);
 void            TSR_rewind(TaskSegRaw *tsrp);
 unsigned        TSR_size(TaskSegRaw *tsrp, TSTaskType filter);
 void            TSR_eval(TaskSegRaw *tsrp);
+uint64_t        TSR_hash(const TaskSegRaw *tsrp);
+int             TSR_equal(const TaskSegRaw *tsr1p, const TaskSegRaw *tsr2p);
 TSRRes          TSR_merge(TaskSegRaw *restrict tsegp1, TaskSegRaw *restrict tsegp2);
 double          TaskSegRaw_ctx_seg_meanlen(TaskSegRawCtx *ctx);
 int             TaskSegRawCtx_to_file(TaskSegRawCtx *ctx, FILE *wfp);
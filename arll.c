@@ -23,8 +23,16 @@
 static const arll arll_zero = { 0 };
 
 static inline int arll_realloc(arll *arllp, unsigned newsiz) {
-    void *np = realloc(arllp->blk_l, newsiz * arllp->blk_siz);
+    void *np;
+    if (arllp->blk_ext) {
+        /* move out of the external storage */
+        np = malloc(newsiz * arllp->blk_siz);
+        if (np) memcpy(np, arllp->blk_l, arllp->blk_cnt * arllp->blk_siz);
+    } else {
+        np = realloc(arllp->blk_l, newsiz * arllp->blk_siz);
+    }
     if (np) {
+        arllp->blk_ext = 0;
         arllp->blk_l = np;
         arllp->blk_lsiz = newsiz;
         return 0;
@@ -104,16 +112,60 @@ int arll_push(arll *arllp, const void *blkp)
     return arllp->blk_cnt++;
 }
 
+/* Remove the last object of the list, e.g. to use the list as a stack. The
+ * iterator is moved back if it was past the removed object.
+ * @param arllp pointer to the arll object
+ * @param blkp where the contents of the removed object are copied, can be NULL
+ * @return 0 on success, -1 if the list is empty */
+int arll_pop(arll *arllp, void *blkp)
+{
+    assert(arllp);
+    if (!arllp->blk_cnt) return -1;
+
+    arllp->blk_cnt--;
+    if (blkp)
+        memcpy(blkp, ((char*)arllp->blk_l) + arllp->blk_cnt * arllp->blk_siz,
+            arllp->blk_siz);
+    if (arllp->blk_curi > arllp->blk_cnt) arllp->blk_curi = arllp->blk_cnt;
+    return 0;
+}
+
 /* Destroys an arll object and frees the memory associated with it.
  * @param arllp pointer to the arllp object to be destroyed */
 void arll_destroy(arll *arllp)
 {
     if (arllp) {
-        free(arllp->blk_l);
+        arll_deinit(arllp);
         free(arllp);
     }
 }
 
+/* Initializes an arll object in place, storing the first objects in an
+ * external buffer, e.g. embedded in the owner of the list. The objects are
+ * moved to the heap once the buffer is full. Deinit with arll_deinit().
+ * @param arllp pointer to the arll object
+ * @param blk_siz size of the objects stored in the list
+ * @param buf external buffer, valid as long as the list
+ * @param buf_lsiz number of objects fitting in 'buf' */
+void arll_init_buf(arll *arllp, uint16_t blk_siz, void *buf, unsigned buf_lsiz)
+{
+    assert(arllp && blk_siz && buf && buf_lsiz);
+    *arllp = arll_zero;
+    arllp->blk_siz = blk_siz;
+    arllp->blk_l = buf;
+    arllp->blk_lsiz = buf_lsiz;
+    arllp->blk_ext = 1;
+}
+
+/* Frees the memory associated with an arll object, but not the object itself.
+ * @param arllp pointer to the arll object */
+void arll_deinit(arll *arllp)
+{
+    assert(arllp);
+    if (!arllp->blk_ext) free(arllp->blk_l);
+    arllp->blk_l = NULL;
+}
+
 /* @return the index of an object in the list that would be returned by a call to
  * arll_next().
  * @param arllp pointer to the arll object */
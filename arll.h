@@ -20,7 +20,7 @@
 
 #include <stdint.h>
 
-/* Array Linked List. Iterable. Can only be appended, no deletion supported.
+/* Array Linked List. Iterable. Can only be appended, or popped from the end.
  * Only for objects of fixed size.*/
 
 typedef struct {
@@ -29,6 +29,8 @@ typedef struct {
     unsigned    blk_lsiz;
     unsigned    blk_curi;
     uint16_t    blk_siz;
+    /* blk_l is external storage, not owned by the list, see arll_init_buf() */
+    uint8_t     blk_ext;
 } arll;
 
 arll        *arll_construct(uint16_t blk_siz, unsigned init_lsiz);
@@ -36,7 +38,14 @@ void        *arll_next(arll *arllp);
 void        arll_rewind(arll *arllp);
 void        *arll_geti(arll *arllp, unsigned i);
 int         arll_push(arll *arllp, const void *blkp);
+int         arll_pop(arll *arllp, void *blkp);
 void        arll_destroy(arll *arllp);
+void        arll_init_buf(
+    arll *arllp,
+    uint16_t blk_siz,
+    void *buf,
+    unsigned buf_lsiz);
+void        arll_deinit(arll *arllp);
 int         arll_get_nexti(const arll *arllp);
 unsigned    arll_len(const arll *arllp);
 
@@ -106,6 +106,49 @@ int ElemCtx_init(ElemCtx *ctx)
     return 0;
 }
 
+/* Move an Elem object to the head of the list of its context, i.e. where
+ * Elem_init() registers new objects.
+ * @param ep pointer to the Elem object to be moved */
+void Elem_move_head(Elem *ep)
+{
+    assert(ep && ep->ctxp);
+    ElemCtx *ctx = ep->ctxp;
+    if (ctx->elem_dll == ep) return;
+
+    if (ep->next_p) ep->next_p->prev_next_pp = ep->prev_next_pp;
+    *(ep->prev_next_pp) = ep->next_p;
+
+    ctx->elem_dll->prev_next_pp = &ep->next_p;
+    ep->next_p = ctx->elem_dll;
+    ep->prev_next_pp = &ctx->elem_dll;
+    ctx->elem_dll = ep;
+}
+
+/* Move an Elem object from its context to the head of the list of another
+ * one, as if it was deinitialized and initialized in 'ctx'.
+ * @param ep pointer to the Elem object to be moved
+ * @param ctx pointer to the ElemCtx context the object is moved into */
+void Elem_move_ctx(Elem *ep, ElemCtx *ctx)
+{
+    assert(ep && ep->ctxp && ctx);
+    assert(ep->ctxp->size);
+    ep->ctxp->size--;
+
+    if (ep->next_p) ep->next_p->prev_next_pp = ep->prev_next_pp;
+    *(ep->prev_next_pp) = ep->next_p;
+
+    if (ctx->elem_dll) {
+        ctx->elem_dll->prev_next_pp = &ep->next_p;
+    }
+    ep->next_p = ctx->elem_dll;
+    ep->prev_next_pp = &ctx->elem_dll;
+    ctx->elem_dll = ep;
+
+    ep->ctxp = ctx;
+    ep->idx = -1;
+    ctx->size++;
+}
+
 /* Assigns unique indexes to all the Elem objects tracked by the context pointed
  * by 'ctx', in the order they appear in the doubly linked list.
  * @param ctx pointer to the ElemCtx context into object
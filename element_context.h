@@ -65,6 +65,8 @@ struct ElemCtx{
 int Elem_init(ElemCtx *ctx, Elem *ep);
 int ElemCtx_init(ElemCtx *ctx);
 int ElemCtx_assign_idx(ElemCtx *ctx);
+void Elem_move_head(Elem *ep);
+void Elem_move_ctx(Elem *ep, ElemCtx *ctx);
 
 /* @return return the index of an Elem object previously assigned by
  * ElemCtx_assign_idx().
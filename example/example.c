@@ -123,9 +123,17 @@ int main(void)
 
     /* Aimed minining. This has the scope of finding similar segments
      * candidates. All the vertices found to be roots of similar PPMs are
-     * grouped together. */
-    GM_mine_for_symm(pm_ctx);
-    GM_mine_for_asymm(pm_ctx);
+     * grouped together. The first two miners run on the compact store of the
+     * tree, which has to be dropped before GM_mine_recurrence() adds
+     * wrappers. */
+    PMCompact *compact = PMCompact_create(pm_ctx);
+    if (!compact) {
+        printf("PM: cannot create the compact store of the tree.\n");
+        return -1;
+    }
+    GM_mine_for_symm_compact(compact);
+    GM_mine_for_asymm_compact(compact);
+    PMCompact_destroy(compact);
     GM_mine_recurrence(pm_ctx);
 
     /* The vertex groups also form the compressed PPM tree. */
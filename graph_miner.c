@@ -18,28 +18,13 @@
 #include "graph_miner.h"
 #include "pm.h"
 
-static void _mine_for_symm(PMV *vp)
-{
-    if (!vp) return;
-    switch (vp->type) {
-    case PMV_seg:
-        break;
-    case PMV_insc:
-        _mine_for_symm(vp->pp);
-        _mine_for_symm(vp->cp);
-
-        if (PMV_insc_is_symm(vp))
-            PMV_merge_r(vp->pp, vp->cp);
-
-        break;
-    case PMV_wrap:
-        _mine_for_symm(vp->wp);
-        break;
-    default:
-        assert(0);
-    }
+static PMWRes _mine_for_symm_post(PMWalk *walkp, PMV *vp)
+{
+    (void)walkp;
+    if (vp->type == PMV_insc && PMV_insc_is_symm(vp))
+        PMV_merge_r(vp->pp, vp->cp);
 
-    _mine_for_symm(vp->np);
+    return PMW_cont;
 }
 
 /* Mine for similar subtrees in the form of symmetrical branches.
@@ -47,55 +32,169 @@ static void _mine_for_symm(PMV *vp)
 void GM_mine_for_symm(PMContext *ctx)
 {
     assert(ctx);
-    _mine_for_symm(ctx->headp);
+    PMWalk walk = { .post = _mine_for_symm_post };
+    PMV_walk(&walk, ctx->headp);
 }
 
-static void _mine_for_asymm(PMV *vp)
+static PMWRes _mine_for_asymm_post(PMWalk *walkp, PMV *vp)
 {
-    if (!vp) return;
+    (void)walkp;
+    if (vp->type != PMV_insc || PMV_insc_is_symm(vp)) return PMW_cont;
 
-    switch (vp->type) {
-    case PMV_seg:
-        break;
+    PMV *haystackp, *needlep;
 
-    case PMV_wrap:
-        _mine_for_asymm(vp->wp);
-        break;
+    arll *simp_arll = arll_construct(sizeof(PMV*), 1);
+    assert(simp_arll);
 
-    case PMV_insc:
-        _mine_for_asymm(vp->pp);
-        _mine_for_asymm(vp->cp);
+    haystackp = vp->pp;
+    needlep = vp->cp;
 
-        if (!PMV_insc_is_symm(vp)) {
-            PMV *haystackp, *needlep;
+    GM_find_terminating(haystackp, needlep, simp_arll);
+    if (arll_len(simp_arll) == 0) {
+        haystackp = vp->cp;
+        needlep = vp->pp;
+        GM_find_terminating(haystackp, needlep, simp_arll);
+    }
 
-            arll *simp_arll = arll_construct(sizeof(PMV*), 1);
-            assert(simp_arll);
+    PMV **cvpp;
+    arll_rewind(simp_arll);
+    while ((cvpp = arll_next(simp_arll))) {
+        PMV_merge_r(needlep, *cvpp);
+    }
+    arll_destroy(simp_arll);
 
-            haystackp = vp->pp;
-            needlep = vp->cp;
+    return PMW_cont;
+}
 
-            GM_find_terminating(haystackp, needlep, simp_arll);
-            if (arll_len(simp_arll) == 0) {
-                haystackp = vp->cp;
-                needlep = vp->pp;
-                GM_find_terminating(haystackp, needlep, simp_arll);
-            }
+/* @return pointer to the first vertex in [first, last) not before v, last if
+ *  none
+ * @param first pointer to the first of vertices in layout order
+ * @param last pointer past the last one
+ * @param v vertex */
+static const PMFV *_lower_bound(const PMFV *first, const PMFV *last, PMFV v)
+{
+    while (first < last) {
+        const PMFV *mid = first + (last - first) / 2;
+        if (*mid < v) first = mid + 1;
+        else last = mid;
+    }
+    return first;
+}
 
-            PMV **cvpp;
-            arll_rewind(simp_arll);
-            while ((cvpp = arll_next(simp_arll))) {
-                PMV_merge_r(needlep, *cvpp);
-            }
-            arll_destroy(simp_arll);
+/* Searches for needle sub-tree in haystack sub-tree of a frozen tree, as
+ * GM_find_terminating(), by looking the class of the needle up in the index.
+ * The matches are the vertices of the class in the range of the haystack,
+ * thus they are consecutive in the index.
+ * @param fzp pointer to the frozen tree, indexed, see PMContext_index()
+ * @param haystack haystack vertex
+ * @param needle needle vertex
+ * @param lop pointer to where the index of the first match in fzp->clsv is
+ *  stored
+ * @return number of matches
+ * @pre no wrappers in the tree, as only then the class tells similarity */
+static PMFV _find_terminating_indexed(
+    const PMFrozen *fzp,
+    PMFV haystack,
+    PMFV needle,
+    PMFV *lop)
+{
+    if (haystack == PMFV_nil || needle == PMFV_nil) return 0;
+
+    const uint32_t cls = fzp->vpl[needle]->cls;
+    const PMFV *first = fzp->clsv + fzp->clsoff[cls];
+    const PMFV *last = fzp->clsv + fzp->clsoff[cls + 1];
+
+    /* similar trees are of the same size, so none holds another one */
+    const PMFV *lo = _lower_bound(first, last, haystack);
+    const PMFV *hi = _lower_bound(lo, last, fzp->end[haystack]);
+
+    *lop = lo - fzp->clsv;
+    return hi - lo;
+}
+
+/* @return the last index of the run of an index in fzp->clsv, see
+ *  _merge_matches()
+ * @param runl the runs, each index links to a later one of the run or to
+ *  itself if the last */
+static PMFV _run_last(PMFV *runl, PMFV i)
+{
+    PMFV last = i;
+    while (runl[last] != last) last = runl[last];
+
+    while (runl[i] != i) {
+        PMFV next = runl[i];
+        runl[i] = last;
+        i = next;
+    }
+    return last;
+}
+
+/* Merge a needle with the matches at [lo, hi) in the class index. Trees are
+ * only ever merged as a whole, so all the matches are in one group after and
+ * stay so: they are joined into a run, which later needles of the class merge
+ * with once.
+ * @param fzp pointer to the frozen tree, indexed
+ * @param runl the runs in fzp->clsv, see _run_last()
+ * @param cp pointer to the compact store of the tree to merge on, NULL to
+ *  merge on the tree
+ * @param needle needle vertex
+ * @param lo index of the first match
+ * @param hi index past the last match */
+static void _merge_matches(
+    const PMFrozen *fzp,
+    PMFV *runl,
+    PMCompact *cp,
+    PMFV needle,
+    PMFV lo,
+    PMFV hi)
+{
+    PMV *needlep = fzp->vpl[needle];
+    for (PMFV i = lo; i < hi;) {
+        PMFV match = fzp->clsv[i];
+        if (PMV_getgroup(fzp->vpl[match]) != PMV_getgroup(needlep)) {
+            if (cp) PMCV_merge(cp, needle, match);
+            else PMV_merge_r(needlep, fzp->vpl[match]);
         }
-        break;
 
-    default:
-        assert(0);
+        PMFV last = _run_last(runl, i);
+        if (last + 1 < hi) runl[last] = last + 1;
+        i = last + 1;
     }
+}
+
+/* Mine for similar subtrees in asymmetrical branches, by looking the
+ * branches up in the class index.
+ * @param fzp pointer to the frozen tree, indexed
+ * @param cp pointer to the compact store of the tree to mine on, NULL to mine
+ *  on the tree
+ * @pre no wrappers in the tree */
+static void _mine_for_asymm_indexed(const PMFrozen *fzp, PMCompact *cp)
+{
+    /* one more, so that no allocation is empty */
+    PMFV *runl = malloc(sizeof(*runl) * (fzp->cnt + 1));
+    assert(runl);
+    for (PMFV i = 0; i < fzp->cnt; i++) runl[i] = i;
+
+    for (PMFV v = 0; v < fzp->cnt; v++) {
+        if ((fzp->shape[v] & PMFZ_TYPE) != PMV_insc) continue;
+        if (cp ?
+            cp->flags[v] & PMCV_F_INSC_is_sym :
+            PMV_insc_is_symm(fzp->vpl[v]))
+            continue;
+
+        PMFV needle = PMFrozen_b2(fzp, v);
+        PMFV lo;
+        PMFV cnt = _find_terminating_indexed(
+            fzp, PMFrozen_b1(fzp, v), needle, &lo);
+        if (cnt == 0) {
+            needle = PMFrozen_b1(fzp, v);
+            cnt = _find_terminating_indexed(
+                fzp, PMFrozen_b2(fzp, v), needle, &lo);
+        }
 
-    _mine_for_asymm(vp->np);
+        if (cnt) _merge_matches(fzp, runl, cp, needle, lo, lo + cnt);
+    }
+    free(runl);
 }
 
 /* Mine for similar subtrees in asymmetrical branches.
@@ -103,25 +202,59 @@ static void _mine_for_asymm(PMV *vp)
 void GM_mine_for_asymm(PMContext *ctx)
 {
     assert(ctx);
-    _mine_for_asymm(ctx->headp);
+    if (ctx->pmvcnt[PMV_wrap]) {
+        PMWalk walk = { .post = _mine_for_asymm_post };
+        PMV_walk(&walk, ctx->headp);
+        return;
+    }
+
+    /* without wrappers the merges leave the tree, thus the index, as it is */
+    _mine_for_asymm_indexed(PMContext_index(ctx), NULL);
+}
+
+/* Mine for similar subtrees all over the tree, wherever they are, instead of
+ * among the branches of an inosculation only. The similar trees are those of
+ * one class, found in the class index.
+ *
+ * PMV_merge_r() on two similar trees merges their vertices pairwise, and the
+ * pairs are of one class as well. Merging every tree of a class thus amounts
+ * to joining the groups of all the classes, which merges each vertex once
+ * instead of once for every tree it is part of.
+ * @param ctx pointer to the PM context
+ * @pre no wrappers in the tree, i.e. before GM_mine_recurrence() */
+void GM_mine_global(PMContext *ctx)
+{
+    assert(ctx);
+    assert(ctx->pmvcnt[PMV_wrap] == 0);
+    const PMFrozen *fzp = PMContext_index(ctx);
+
+    for (uint32_t c = 0; c < fzp->clscnt; c++) {
+        const PMFV first = fzp->clsoff[c], last = fzp->clsoff[c + 1];
+        if (last - first < 2) continue;
+
+        PMVG *gp = fzp->vpl[fzp->clsv[first]]->gp;
+        for (PMFV i = first + 1; i < last; i++)
+            assert(PMVG_merge(gp, fzp->vpl[fzp->clsv[i]]->gp) == 0);
+    }
 }
 
 #define GM_RECURRING_ADDED 0x1
 
-static void _mine_recurrence(PMV *vp, PMContext *ctx)
+/* only the branches of inosculations are mined */
+static PMWRes _mine_recurrence_pre(PMWalk *walkp, PMV *vp)
 {
-    if (!vp) return;
-    if (vp->type == PMV_insc) {
-        _mine_recurrence(vp->pp, ctx);
-        _mine_recurrence(vp->cp, ctx);
-    }
+    (void)walkp;
+    return vp->type == PMV_insc ? PMW_cont : PMW_prune;
+}
 
+static PMWRes _mine_recurrence_post(PMWalk *walkp, PMV *vp)
+{
     PMV *vendp, *nendp;
     PMV *np = vp->np;
     PMV *np_recursion = vp->np;
 
     if (vp->external.as_uint & GM_RECURRING_ADDED)
-        goto _mine_recurrence_continue;
+        return PMW_cont;
 
     char first_recurrence = 1;
     char first_not_matching = 1;
@@ -161,8 +294,8 @@ static void _mine_recurrence(PMV *vp, PMContext *ctx)
         }
     }
 
-_mine_recurrence_continue:
-    _mine_recurrence(np_recursion, ctx);
+    PMV_walk_continue(walkp, np_recursion);
+    return PMW_cont;
 }
 
 /* Mine the PPM tree for recurring patterns. Recurring patterns are parts of the
@@ -172,7 +305,31 @@ _mine_recurrence_continue:
 void GM_mine_recurrence(PMContext *ctx)
 {
     assert(ctx);
-    _mine_recurrence(ctx->headp, ctx);
+    PMWalk walk = {
+        .pre = _mine_recurrence_pre,
+        .post = _mine_recurrence_post
+    };
+    PMV_walk(&walk, ctx->headp);
+}
+
+typedef struct {
+    PMV *needle;
+    arll *similarl;
+} GMFind;
+
+static PMWRes _find_terminating_pre(PMWalk *walkp, PMV *vp)
+{
+    GMFind *fp = walkp->arg;
+
+    if (PMV_is_similar(vp, fp->needle, 1)) {
+        arll_push(fp->similarl, &vp);
+        return PMW_cut;
+    }
+
+    if (vp->depth < fp->needle->depth) return PMW_cut;
+    if (vp->vcnt < fp->needle->vcnt) return PMW_cut;
+
+    return PMW_cont;
 }
 
 /* Searches for needle sub-tree in haystack sub-tree  and returns a list of
@@ -184,32 +341,72 @@ void GM_mine_recurrence(PMContext *ctx)
 void GM_find_terminating(PMV *haystack, PMV *needle, arll *similarl)
 {
     assert(similarl);
-    if (!haystack) return;
-
-    if (PMV_is_similar(haystack, needle, 1)) {
-        arll_push(similarl, &haystack);
-        return;
-    }
-
-    if (haystack->depth < needle->depth) return;
-    if (haystack->vcnt < needle->vcnt) return;
-
-    switch (haystack->type) {
-    case PMV_seg:
-        break;
-
-    case PMV_insc:
-        GM_find_terminating(haystack->pp, needle, similarl);
-        GM_find_terminating(haystack->cp, needle, similarl);
-        break;
+    GMFind find = { .needle = needle, .similarl = similarl };
+    PMWalk walk = { .pre = _find_terminating_pre, .arg = &find };
+    PMV_walk(&walk, haystack);
+}
 
-    case PMV_wrap:
-        GM_find_terminating(haystack->wp, needle, similarl);
-        break;
+/* The miners below run on the compact store of a tree. Their merges only join
+ * groups and leave the structure of the tree, thus the store, untouched, as
+ * long as there are no wrappers. */
+static void _compact_check(PMCompact *cp)
+{
+    assert(cp);
+    /* the layout of the store is the one of the tree */
+    assert(cp->ctx->frozen == cp->fzp);
+    assert(cp->ctx->pmvcnt[PMV_wrap] == 0);
+}
 
-    default:
-        assert(0);
+/* Mine for symmetrical branches, as GM_mine_for_symm(), on the compact store
+ * of the tree.
+ * @param cp pointer to the compact store, see PMCompact_create()
+ * @pre no wrappers in the tree, i.e. before GM_mine_recurrence() */
+void GM_mine_for_symm_compact(PMCompact *cp)
+{
+    _compact_check(cp);
+    for (PMCV v = 0; v < cp->cnt; v++) {
+        if (PMCV_type(cp, v) == PMV_insc &&
+            (cp->flags[v] & PMCV_F_INSC_is_sym))
+            PMCV_merge(cp, PMCV_b1(cp, v), PMCV_b2(cp, v));
     }
+}
+
+/* Mine for similar subtrees in asymmetrical branches, as GM_mine_for_asymm(),
+ * on the compact store of the tree. The matches are looked up in the class
+ * index of its layout, see PMContext_index().
+ * @param cp pointer to the compact store, see PMCompact_create()
+ * @pre no wrappers in the tree, i.e. before GM_mine_recurrence() */
+void GM_mine_for_asymm_compact(PMCompact *cp)
+{
+    _compact_check(cp);
+    const PMFrozen *fzp = PMContext_index(cp->ctx);
+    assert(fzp == cp->fzp);
+    _mine_for_asymm_indexed(fzp, cp);
+}
 
-    GM_find_terminating(haystack->np, needle, similarl);
+/* Searches for needle sub-tree in haystack sub-tree on the compact store, as
+ * GM_find_terminating(), by looking the class of the needle up in the class
+ * index of its layout, see PMContext_index().
+ * @param cp pointer to the compact store
+ * @param haystack haystack vertex
+ * @param needle needle vertex
+ * @param similarl pointer to array where the matches will be added, as PMCV
+ *  handles
+ * @pre no wrappers in the tree, i.e. before GM_mine_recurrence() */
+void GM_find_terminating_compact(
+    PMCompact *cp,
+    PMCV haystack,
+    PMCV needle,
+    arll *similarl)
+{
+    _compact_check(cp);
+    assert(similarl);
+    assert(needle != PMCV_nil);
+    const PMFrozen *fzp = PMContext_index(cp->ctx);
+    assert(fzp == cp->fzp);
+
+    PMFV lo;
+    PMFV cnt = _find_terminating_indexed(fzp, haystack, needle, &lo);
+    for (PMFV i = lo; i < lo + cnt; i++)
+        assert(arll_push(similarl, &fzp->clsv[i]) != -1);
 }
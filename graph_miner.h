@@ -19,11 +19,20 @@
 #define GRAPH_MINER_H_
 
 #include "pm.h"
+#include "pm_compact.h"
 
 void GM_mine_for_symm(PMContext *ctx);
 void GM_mine_for_asymm(PMContext *ctx);
 void GM_find_terminating(PMV *haystack, PMV *needle, arll *similarl);
 void GM_mine_recurrence(PMContext *ctx);
+void GM_mine_global(PMContext *ctx);
+void GM_mine_for_symm_compact(PMCompact *cp);
+void GM_mine_for_asymm_compact(PMCompact *cp);
+void GM_find_terminating_compact(
+    PMCompact *cp,
+    PMCV haystack,
+    PMCV needle,
+    arll *similarl);
 
 
 #endif /* GRAPH_MINER_H_ */
@@ -25,6 +25,7 @@
 #include "../graph_miner.h"
 #include "../model_parser.h"
 #include "../pm.h"
+#include "../pm_compact.h"
 #include "../seg_cluster.h"
 #include "../task_classifier.h"
 
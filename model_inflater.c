@@ -0,0 +1,387 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "model_inflater.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef MP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* size of an inflated block */
+#define MP_INFL_BLKSIZ      (1 << 20)
+/* number of inflated blocks the background thread may be ahead */
+#define MP_INFL_BLKCNT      4
+/* size of the compressed input buffer */
+#define MP_INFL_INSIZ       (1 << 17)
+
+typedef struct {
+    char    *buf;
+    size_t  len;
+} MPInflBlk;
+
+struct MPInflater {
+    FILE            *src;
+    MPZFormat       fmt;
+    /* compressed input */
+    unsigned char   *in;
+    size_t          inlen;
+    int             ineof;
+    /* a gzip member or zstd frame is not complete */
+    int             open;
+    union {
+#ifdef MP_HAVE_ZLIB
+        z_stream        zs;
+#endif
+#ifdef MP_HAVE_ZSTD
+        struct {
+            ZSTD_DStream    *zds;
+            ZSTD_inBuffer   zin;
+        };
+#endif
+        char _none;
+    };
+    /* ring of inflated blocks, 'blkfill' of them starting at 'blkr' */
+    MPInflBlk       blk_l[MP_INFL_BLKCNT];
+    unsigned        blkr;
+    unsigned        blkfill;
+    /* read offset in the block 'blkr' */
+    size_t          blkoff;
+    /* the thread has stopped, its result is 'res' */
+    int             done;
+    MPRes           res;
+    int             stop;
+    pthread_t       thr;
+    pthread_mutex_t mtx;
+    pthread_cond_t  cond_fill;
+    pthread_cond_t  cond_free;
+};
+
+/* @return format of a file, based on its first bytes
+ * @param buf the first bytes of the file
+ * @param len number of bytes in 'buf', should be at least MP_INFL_MAGIC_LEN */
+MPZFormat MPInflater_detect(const void *buf, size_t len)
+{
+    static const unsigned char gz_magic[] = { 0x1f, 0x8b };
+    static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    if (len >= sizeof(gz_magic) && !memcmp(buf, gz_magic, sizeof(gz_magic)))
+        return MPZ_gzip;
+    if (len >= sizeof(zstd_magic)
+        && !memcmp(buf, zstd_magic, sizeof(zstd_magic)))
+        return MPZ_zstd;
+    return MPZ_none;
+}
+
+/* Read the next chunk of compressed input.
+ * @return number of bytes read, 0 at the end of the file or on IO error */
+static size_t _in_fill(MPInflater *ifp)
+{
+    size_t rcnt = fread(ifp->in, 1, MP_INFL_INSIZ, ifp->src);
+    if (rcnt == 0) ifp->ineof = 1;
+    ifp->inlen = rcnt;
+    return rcnt;
+}
+
+#ifdef MP_HAVE_ZLIB
+/* Inflate a gzip file into a block. Concatenated members are supported.
+ * @return MP_ok if the block is full, MP_eof at the end of the file, MP_err
+ *  on corrupt or truncated input */
+static MPRes _gz_fill(MPInflater *ifp, MPInflBlk *bp)
+{
+    z_stream *zs = &ifp->zs;
+    zs->next_out = (unsigned char*)bp->buf;
+    zs->avail_out = MP_INFL_BLKSIZ;
+
+    while (zs->avail_out) {
+        if (!zs->avail_in && !ifp->ineof) {
+            zs->avail_in = _in_fill(ifp);
+            zs->next_in = ifp->in;
+        }
+        if (zs->avail_in) ifp->open = 1;
+
+        /* also called at the end of the input, to flush pending output */
+        int zres = inflate(zs, Z_NO_FLUSH);
+        if (zres == Z_STREAM_END) {
+            ifp->open = 0;
+            inflateReset(zs);
+            continue;
+        }
+        if (zres == Z_BUF_ERROR && !zs->avail_in && ifp->ineof) break;
+        if (zres != Z_OK) {
+            bp->len = MP_INFL_BLKSIZ - zs->avail_out;
+            return MP_err;
+        }
+    }
+
+    bp->len = MP_INFL_BLKSIZ - zs->avail_out;
+    if (zs->avail_out) return ifp->open ? MP_err : MP_eof;
+    return MP_ok;
+}
+#endif
+
+#ifdef MP_HAVE_ZSTD
+/* Inflate a zstd file into a block. Concatenated frames are supported.
+ * @return MP_ok if the block is full, MP_eof at the end of the file, MP_err
+ *  on corrupt or truncated input */
+static MPRes _zstd_fill(MPInflater *ifp, MPInflBlk *bp)
+{
+    ZSTD_outBuffer zout = { bp->buf, MP_INFL_BLKSIZ, 0 };
+    ZSTD_inBuffer *zin = &ifp->zin;
+
+    while (zout.pos < zout.size) {
+        if (zin->pos == zin->size && !ifp->ineof) {
+            zin->size = _in_fill(ifp);
+            zin->pos = 0;
+        }
+
+        /* also called at the end of the input, to flush pending output */
+        size_t opos = zout.pos, ipos = zin->pos;
+        size_t zres = ZSTD_decompressStream(ifp->zds, &zout, zin);
+        if (ZSTD_isError(zres)) {
+            bp->len = zout.pos;
+            return MP_err;
+        }
+        /* no progress, at the end of the input */
+        if (zout.pos == opos && zin->pos == ipos && ifp->ineof) break;
+        /* 0 means the frame is complete and flushed */
+        ifp->open = zres != 0;
+    }
+
+    bp->len = zout.pos;
+    if (zout.pos < zout.size) return ifp->open ? MP_err : MP_eof;
+    return MP_ok;
+}
+#endif
+
+static MPRes _infl_fill(MPInflater *ifp, MPInflBlk *bp)
+{
+    MPRes res = MP_err;
+
+    switch (ifp->fmt) {
+#ifdef MP_HAVE_ZLIB
+    case MPZ_gzip: res = _gz_fill(ifp, bp); break;
+#endif
+#ifdef MP_HAVE_ZSTD
+    case MPZ_zstd: res = _zstd_fill(ifp, bp); break;
+#endif
+    default: (void)bp; assert(0);
+    }
+
+    if (res == MP_eof && ferror(ifp->src)) res = MP_err;
+    return res;
+}
+
+/* Background thread, inflating blocks as long as there is a free one. */
+static void *_infl_run(void *arg)
+{
+    MPInflater *ifp = arg;
+    unsigned blkw = 0;
+    MPRes res;
+
+    do {
+        pthread_mutex_lock(&ifp->mtx);
+        while (ifp->blkfill == MP_INFL_BLKCNT && !ifp->stop)
+            pthread_cond_wait(&ifp->cond_free, &ifp->mtx);
+        int stop = ifp->stop;
+        pthread_mutex_unlock(&ifp->mtx);
+        if (stop) return NULL;
+
+        res = _infl_fill(ifp, &ifp->blk_l[blkw]);
+        blkw = (blkw + 1) % MP_INFL_BLKCNT;
+
+        pthread_mutex_lock(&ifp->mtx);
+        ifp->blkfill++;
+        if (res != MP_ok) {
+            ifp->res = res;
+            ifp->done = 1;
+        }
+        pthread_cond_signal(&ifp->cond_fill);
+        pthread_mutex_unlock(&ifp->mtx);
+    } while (res == MP_ok);
+
+    return NULL;
+}
+
+static MPRes _codec_init(MPInflater *ifp, const void *head, size_t head_len)
+{
+    assert(head_len <= MP_INFL_INSIZ);
+    memcpy(ifp->in, head, head_len);
+    ifp->inlen = head_len;
+
+    switch (ifp->fmt) {
+#ifdef MP_HAVE_ZLIB
+    case MPZ_gzip:
+        ifp->zs.next_in = ifp->in;
+        ifp->zs.avail_in = head_len;
+        /* 32: detect the gzip header */
+        if (inflateInit2(&ifp->zs, 15 + 32) != Z_OK) return MP_mem;
+        return MP_ok;
+#endif
+#ifdef MP_HAVE_ZSTD
+    case MPZ_zstd:
+        ifp->zin = (ZSTD_inBuffer){ ifp->in, head_len, 0 };
+        ifp->zds = ZSTD_createDStream();
+        if (!ifp->zds) return MP_mem;
+        ZSTD_initDStream(ifp->zds);
+        return MP_ok;
+#endif
+    default:
+        printf("[Error][MP][inflater] compressed format %d not supported by "
+            "this build\n", ifp->fmt);
+        return MP_err;
+    }
+}
+
+static void _codec_deinit(MPInflater *ifp)
+{
+    switch (ifp->fmt) {
+#ifdef MP_HAVE_ZLIB
+    case MPZ_gzip: inflateEnd(&ifp->zs); break;
+#endif
+#ifdef MP_HAVE_ZSTD
+    case MPZ_zstd: ZSTD_freeDStream(ifp->zds); break;
+#endif
+    default: break;
+    }
+}
+
+/* Create an inflater for a compressed file, and start inflating it in the
+ * background.
+ * @param ifpp where the inflater is stored
+ * @param src the compressed file, which does not need to be seekable
+ * @param fmt compression format, see MPInflater_detect()
+ * @param head bytes already read from 'src', to be inflated first
+ * @param head_len number of bytes in 'head'
+ * @return MP_ok on success, MP_err if the format is not supported, MP_mem on
+ *  memory allocation or thread creation issues */
+MPRes MPInflater_create(
+    MPInflater **ifpp,
+    FILE *src,
+    MPZFormat fmt,
+    const void *head,
+    size_t head_len)
+{
+    assert(ifpp && src && fmt != MPZ_none);
+
+    MPInflater *ifp = calloc(1, sizeof(*ifp));
+    if (!ifp) return MP_mem;
+    ifp->src = src;
+    ifp->fmt = fmt;
+
+    MPRes res = MP_mem;
+    ifp->in = malloc(MP_INFL_INSIZ);
+    if (!ifp->in) goto fail_in;
+    for (unsigned i = 0; i < MP_INFL_BLKCNT; i++) {
+        ifp->blk_l[i].buf = malloc(MP_INFL_BLKSIZ);
+        if (!ifp->blk_l[i].buf) goto fail_blk;
+    }
+
+    res = _codec_init(ifp, head, head_len);
+    if (res != MP_ok) goto fail_blk;
+
+    pthread_mutex_init(&ifp->mtx, NULL);
+    pthread_cond_init(&ifp->cond_fill, NULL);
+    pthread_cond_init(&ifp->cond_free, NULL);
+    if (pthread_create(&ifp->thr, NULL, _infl_run, ifp)) {
+        res = MP_mem;
+        goto fail_thr;
+    }
+
+    *ifpp = ifp;
+    return MP_ok;
+
+fail_thr:
+    pthread_cond_destroy(&ifp->cond_free);
+    pthread_cond_destroy(&ifp->cond_fill);
+    pthread_mutex_destroy(&ifp->mtx);
+    _codec_deinit(ifp);
+fail_blk:
+    for (unsigned i = 0; i < MP_INFL_BLKCNT; i++) free(ifp->blk_l[i].buf);
+    free(ifp->in);
+fail_in:
+    free(ifp);
+    return res;
+}
+
+/* Read inflated data, blocking until the background thread provides it.
+ * @param ifp the inflater
+ * @param dst where the data is stored
+ * @param n maximum number of bytes to read
+ * @param rcnt where the number of bytes read is stored, 0 at the end of the
+ *  file
+ * @return MP_ok on success, MP_err on IO error or corrupt or truncated input */
+MPRes MPInflater_read(MPInflater *ifp, char *dst, size_t n, size_t *rcnt)
+{
+    assert(ifp && dst && rcnt);
+    *rcnt = 0;
+
+    while (*rcnt == 0 && n) {
+        pthread_mutex_lock(&ifp->mtx);
+        while (!ifp->blkfill && !ifp->done)
+            pthread_cond_wait(&ifp->cond_fill, &ifp->mtx);
+        int empty = !ifp->blkfill;
+        pthread_mutex_unlock(&ifp->mtx);
+        /* 'done' is final */
+        if (empty) return ifp->res == MP_eof ? MP_ok : ifp->res;
+
+        MPInflBlk *bp = &ifp->blk_l[ifp->blkr];
+        size_t cnt = bp->len - ifp->blkoff;
+        if (cnt > n) cnt = n;
+        memcpy(dst, bp->buf + ifp->blkoff, cnt);
+        ifp->blkoff += cnt;
+        *rcnt = cnt;
+
+        if (ifp->blkoff == bp->len) {
+            ifp->blkoff = 0;
+            ifp->blkr = (ifp->blkr + 1) % MP_INFL_BLKCNT;
+            pthread_mutex_lock(&ifp->mtx);
+            ifp->blkfill--;
+            pthread_cond_signal(&ifp->cond_free);
+            pthread_mutex_unlock(&ifp->mtx);
+        }
+    }
+
+    return MP_ok;
+}
+
+/* Stop the background thread and destroy the inflater. The source file is not
+ * closed.
+ * @param ifp the inflater, can be NULL */
+void MPInflater_destroy(MPInflater *ifp)
+{
+    if (!ifp) return;
+
+    pthread_mutex_lock(&ifp->mtx);
+    ifp->stop = 1;
+    pthread_cond_signal(&ifp->cond_free);
+    pthread_mutex_unlock(&ifp->mtx);
+    pthread_join(ifp->thr, NULL);
+
+    pthread_cond_destroy(&ifp->cond_free);
+    pthread_cond_destroy(&ifp->cond_fill);
+    pthread_mutex_destroy(&ifp->mtx);
+    _codec_deinit(ifp);
+    for (unsigned i = 0; i < MP_INFL_BLKCNT; i++) free(ifp->blk_l[i].buf);
+    free(ifp->in);
+    free(ifp);
+}
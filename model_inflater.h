@@ -0,0 +1,49 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef MODEL_INFLATER_H_
+#define MODEL_INFLATER_H_
+/*
+ * Decompression of compressed model files, for the streaming mode of the
+ * model parser. The file is inflated by a background thread, block by block,
+ * while the parser consumes the previous blocks.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include "model_parser.h"
+
+typedef enum {
+    MPZ_none,
+    MPZ_gzip,
+    MPZ_zstd
+} MPZFormat;
+
+/* number of magic bytes needed by MPInflater_detect() */
+#define MP_INFL_MAGIC_LEN   4
+
+typedef struct MPInflater MPInflater;
+
+MPZFormat MPInflater_detect(const void *buf, size_t len);
+MPRes MPInflater_create(
+    MPInflater **ifpp,
+    FILE *src,
+    MPZFormat fmt,
+    const void *head,
+    size_t head_len);
+MPRes MPInflater_read(MPInflater *ifp, char *dst, size_t n, size_t *rcnt);
+void MPInflater_destroy(MPInflater *ifp);
+#endif
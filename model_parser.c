@@ -16,24 +16,38 @@
  * */
 
 #include "model_parser.h"
+#include "ulmap.h"
+#include "model_inflater.h"
 #include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <float.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <glob.h>
 
 static const MPTask     task_empty  = { 0 };
 static const MParser    mparser_empty = { 0 };
 
-/* Init a context for parsing a PPM model file. This also allocates memory for
- * the vertex list.
+/* initial size of the read buffer of the streaming mode */
+#define MP_STREAM_BUFSIZ (1 << 16)
+
+/* Init a context for parsing a PPM model file. The file is scanned for the
+ * range of the task numbers; the task list is allocated by MParser_parse(), so
+ * the mode flags (see MPF_sparse) may be set in between.
  * @param ctx pointer to parsing context
  * @param src source file pointer
  * @param cap_val_com cap the weights of the communication tasks. Set to -1 for
  *  no capping
  * @param cap_val_cal cap the weights of the calculation tasks. Set to -1 for no
  *  capping
- * @return MP_ok on success, MP_err on IO error or file corruption, MP_mem on
- *  memory allocation issues */
+ * @return MP_ok on success, MP_err on IO error or file corruption */
 MPRes MParser_init(
     MParser *ctx,
     FILE *src,
@@ -66,15 +80,535 @@ MPRes MParser_init(
 
     ctx->head = tno_min;
     ctx->task_llen = tno_max + 1;
-    ctx->task_l = malloc(ctx->task_llen  * sizeof(MPTask));
-    if (!ctx->task_l) return MP_mem;
 
     return MP_ok;
 }
 
-/* Start the parsing of the model.
+/* Hand-written tokenizer for the model lines. The scanners work on the
+ * [p, end) range of a line, which does not need to be null-terminated, and
+ * return the position right after the scanned token, or NULL if the token is
+ * not found. Like scanf(), they skip leading white space. */
+
+/* Classify and convert eight digits at once, where the byte order allows it */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MP_SWAR_DIGITS
+#endif
+
+static const uint64_t pow10_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/* powers of ten exactly representable as double */
+static const double pow10_dbl[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline int _is_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline const char *_skip_space(const char *p, const char *end)
+{
+    while (p < end && _is_space(*p)) p++;
+    return p;
+}
+
+/* Scan a run of decimal digits. No white space is skipped.
+ * @param val where the value is stored. It wraps around past 19 digits.
+ * @param ndig where the number of digits is stored */
+static inline const char *_scan_digits(
+    const char *p,
+    const char *end,
+    uint64_t *val,
+    unsigned *ndig)
+{
+    const char *beg = p;
+    uint64_t v = 0;
+
+#ifdef MP_SWAR_DIGITS
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        /* non-zero in each byte not holding a digit */
+        uint64_t nd =
+            ((w & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL) |
+            (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^
+             0x3030303030303030ULL);
+        unsigned n = nd ? __builtin_ctzll(nd) / 8 : 8;
+        if (n == 0) break;
+
+        /* keep the n digits, the bytes below become leading zeros */
+        uint64_t d = (w - 0x3030303030303030ULL) << (64 - 8 * n);
+        d = (d * 10 + (d >> 8)) & 0x00FF00FF00FF00FFULL;
+        d = (d * 100 + (d >> 16)) & 0x0000FFFF0000FFFFULL;
+        d = (d * 10000 + (d >> 32)) & 0xFFFFFFFFULL;
+
+        v = v * pow10_u64[n] + d;
+        p += n;
+        if (n < 8) goto out;
+    }
+#endif
+    while (p < end && (unsigned char)(*p - '0') < 10)
+        v = v * 10 + (*p++ - '0');
+
+#ifdef MP_SWAR_DIGITS
+out:
+#endif
+    if (p == beg) return NULL;
+    *val = v;
+    *ndig = p - beg;
+    return p;
+}
+
+static inline const char *_scan_ulong(
+    const char *p,
+    const char *end,
+    unsigned long *val)
+{
+    uint64_t v;
+    unsigned ndig;
+
+    p = _scan_digits(_skip_space(p, end), end, &v, &ndig);
+    if (p) *val = v;
+    return p;
+}
+
+static inline const char *_scan_int(const char *p, const char *end, int *val)
+{
+    uint64_t v;
+    unsigned ndig;
+    int neg = 0;
+
+    p = _skip_space(p, end);
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    p = _scan_digits(p, end, &v, &ndig);
+    if (p) *val = neg ? -(int)v : (int)v;
+    return p;
+}
+
+/* Fallback for the numbers _scan_double() can not convert exactly */
+static const char *_scan_double_slow(
+    const char *p,
+    const char *end,
+    double *val)
+{
+    char numbuf[64];
+    char *nend;
+    size_t len = end - p < (long)sizeof(numbuf) ? (size_t)(end - p) :
+        sizeof(numbuf) - 1;
+
+    memcpy(numbuf, p, len);
+    numbuf[len] = 0;
+    *val = strtod(numbuf, &nend);
+    return nend == numbuf ? NULL : p + (nend - numbuf);
+}
+
+/* Scan a floating point number. Numbers with up to 19 significant digits and
+ * a small decimal exponent are converted with a single multiplication or
+ * division, which is exact. The rest is left to strtod(), so the result is
+ * always the one of strtod(). */
+static inline const char *_scan_double(
+    const char *p,
+    const char *end,
+    double *val)
+{
+    uint64_t ip = 0, fp = 0, e;
+    unsigned idig = 0, fdig = 0, edig;
+    long exp = 0;
+    int neg = 0;
+    const char *q;
+
+    p = _skip_space(p, end);
+    const char *beg = p;
+
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    if ((q = _scan_digits(p, end, &ip, &idig))) p = q;
+    if (p < end && *p == '.') {
+        p++;
+        if ((q = _scan_digits(p, end, &fp, &fdig))) p = q;
+    }
+    /* inf, nan, hexadecimal... */
+    if (idig + fdig == 0 || (p < end && (*p == 'x' || *p == 'X')))
+        return _scan_double_slow(beg, end, val);
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int eneg = 0;
+        q = p + 1;
+        if (q < end && (*q == '-' || *q == '+')) eneg = *q++ == '-';
+        /* no digits: the 'e' is not part of the number */
+        if ((q = _scan_digits(q, end, &e, &edig))) {
+            if (edig > 4) return _scan_double_slow(beg, end, val);
+            exp = eneg ? -(long)e : (long)e;
+            p = q;
+        }
+    }
+
+    if (idig + fdig > 19) return _scan_double_slow(beg, end, val);
+    uint64_t m = ip * pow10_u64[fdig] + fp;
+    exp -= fdig;
+    if (m > (1ULL << 53) || exp < -22 || exp > 22)
+        return _scan_double_slow(beg, end, val);
+
+    double d = m;
+    d = exp < 0 ? d / pow10_dbl[-exp] : d * pow10_dbl[exp];
+    *val = neg ? -d : d;
+    return p;
+}
+
+/* Match the separator "->" or "--", skipping leading white space */
+static inline const char *_scan_sep(
+    const char *p,
+    const char *end,
+    const char sep[2])
+{
+    p = _skip_space(p, end);
+    if (end - p < 2 || p[0] != sep[0] || p[1] != sep[1]) return NULL;
+    return p + 2;
+}
+
+/* Parse a single line of the model. The line format is:
+ *  tno pno ttype mem [req] [-- dest [dpno dtype]] [-> next [pno ttype]]...
+ * @param lp start of the line
+ * @param end end of the line (exclusive), the line break may be included
+ * @param tno where the task number is stored
+ * @param ct where the task is stored
+ * @return 1 if a task was parsed, 0 if the line holds no task (e.g. comment),
+ *  -1 on corruption */
+static int _parse_line(
+    const char *lp,
+    const char *end,
+    TaskNo *tno,
+    MPTask *ct)
+{
+    unsigned long skip;
+    int ttype;
+    const char *p;
+
+    if (lp == end || *lp < '0' || *lp > '9') return 0;
+
+    *ct = task_empty;
+
+    if (!(lp = _scan_ulong(lp, end, tno)) ||
+        !(lp = _scan_int(lp, end, &ct->pno)) ||
+        !(lp = _scan_int(lp, end, &ttype)) ||
+        !(lp = _scan_ulong(lp, end, &ct->mem)))
+        return -1;
+    ct->ttype = ttype;
+
+    switch (ct->ttype) {
+    case MPTT_start:
+    case MPTT_forkend:
+    case MPTT_join:
+        if (!(lp = _scan_sep(lp, end, "->")) ||
+            !(lp = _scan_ulong(lp, end, &ct->next[0])))
+            return -1;
+        break;
+
+    case MPTT_end:
+        break;
+
+    case MPTT_fork:
+        if (!(lp = _scan_sep(lp, end, "->")) ||
+            !(lp = _scan_ulong(lp, end, &ct->next[0])))
+            return -1;
+        /* a missing second branch means empty fork, next[1] stays zero */
+        if ((p = _scan_ulong(lp, end, &skip)) &&
+            (p = _scan_ulong(p, end, &skip)) &&
+            (p = _scan_sep(p, end, "->")) &&
+            (p = _scan_ulong(p, end, &ct->next[1])))
+            lp = p;
+        break;
+
+    case MPTT_calc:
+        if (!(lp = _scan_double(lp, end, &ct->req)) ||
+            !(lp = _scan_sep(lp, end, "->")) ||
+            !(lp = _scan_ulong(lp, end, &ct->next[0])))
+            return -1;
+        break;
+
+    case MPTT_com:
+        if (!(lp = _scan_double(lp, end, &ct->req)) ||
+            !(lp = _scan_sep(lp, end, "--")) ||
+            !(lp = _scan_ulong(lp, end, &ct->dest)))
+            return -1;
+
+        /* dest == 0 => broadcast, no destination process and type */
+        if (ct->dest != 0 &&
+            (!(lp = _scan_ulong(lp, end, &skip)) ||
+             !(lp = _scan_ulong(lp, end, &skip))))
+            return -1;
+        if (!(lp = _scan_sep(lp, end, "->")) ||
+            !(lp = _scan_ulong(lp, end, &ct->next[0])))
+            return -1;
+        break;
+
+    default:
+        return -1;
+    }
+
+    return 1;
+}
+
+/* Task list storage. By default the task list is an array of MPTask. With
+ * MPF_columnar, every field is stored in its own column instead, and only the
+ * fields needed to build the PPM are kept (see MPCols). */
+
+typedef struct {
+    void    **colp;
+    size_t  elsiz;
+} MPColRef;
+
+/* @return number of columns allocated by the parser, their references in
+ * 'refs' */
+static unsigned _cols_refs(MPCols *cols, MPColRef refs[MP_COLS_MAX])
+{
+    unsigned n = 0;
+
+    refs[n++] = (MPColRef){ (void**)&cols->ttype, sizeof(*cols->ttype) };
+    refs[n++] = (MPColRef){ (void**)&cols->pno, sizeof(*cols->pno) };
+    refs[n++] = (MPColRef){ (void**)&cols->req, sizeof(*cols->req) };
+    refs[n++] = (MPColRef){ (void**)&cols->next, sizeof(*cols->next) };
+#ifdef MP_COLS_DEBUG
+    refs[n++] = (MPColRef){ (void**)&cols->mem, sizeof(*cols->mem) };
+    refs[n++] = (MPColRef){ (void**)&cols->dest, sizeof(*cols->dest) };
+    refs[n++] = (MPColRef){ (void**)&cols->lno, sizeof(*cols->lno) };
+#endif
+    return n;
+}
+
+/* Resize the task list from 'osiz' to 'nsiz' entries. New entries are zeroed.
+ * @return MP_ok on success, MP_mem on memory allocation failure. The task
+ *  list keeps at least min(osiz, nsiz) entries on failure */
+static MPRes _task_l_resize(MParser *ctx, unsigned long osiz, unsigned long nsiz)
+{
+    MPColRef refs[MP_COLS_MAX] = { { (void**)&ctx->task_l, sizeof(MPTask) } };
+    unsigned cnt = ctx->flags & MPF_columnar ? _cols_refs(&ctx->cols, refs) : 1;
+
+    for (unsigned i = 0; i < cnt; i++) {
+        char *ncol = realloc(*refs[i].colp, nsiz * refs[i].elsiz);
+        if (!ncol && nsiz) return MP_mem;
+        if (nsiz > osiz)
+            memset(ncol + osiz * refs[i].elsiz, 0, (nsiz - osiz) * refs[i].elsiz);
+        *refs[i].colp = ncol;
+    }
+    return MP_ok;
+}
+
+static void _task_l_free(MParser *ctx)
+{
+    MPColRef refs[MP_COLS_MAX];
+    unsigned cnt = _cols_refs(&ctx->cols, refs);
+
+    for (unsigned i = 0; i < cnt; i++) {
+        free(*refs[i].colp);
+        *refs[i].colp = NULL;
+    }
+    free(ctx->task_l);
+    ctx->task_l = NULL;
+}
+
+/* Store task 'ct' at index 'i' of the task list.
+ * @return MP_ok on success, MP_err if a successor does not fit the columnar
+ *  layout */
+static inline MPRes _task_put(MParser *ctx, TaskNo i, const MPTask *ct)
+{
+    if (!(ctx->flags & MPF_columnar)) {
+        ctx->task_l[i] = *ct;
+        return MP_ok;
+    }
+
+    MPCols *cols = &ctx->cols;
+    if (ct->next[0] > UINT32_MAX || ct->next[1] > UINT32_MAX) return MP_err;
+    cols->ttype[i] = ct->ttype;
+    cols->pno[i] = ct->pno;
+    cols->req[i] = ct->req;
+    cols->next[i][0] = ct->next[0];
+    cols->next[i][1] = ct->next[1];
+#ifdef MP_COLS_DEBUG
+    cols->mem[i] = ct->mem;
+    cols->dest[i] = ct->dest;
+    cols->lno[i] = ct->lno;
+#endif
+    return MP_ok;
+}
+
+/* Make sure task number 'tno' fits into the task list, growing it if needed.
+ * Newly added entries are zeroed. */
+static MPRes _task_l_reserve(MParser *ctx, unsigned long *lsiz, TaskNo tno)
+{
+    if (tno < *lsiz) return MP_ok;
+
+    unsigned long nsiz = *lsiz ? *lsiz : 1024;
+    while (nsiz <= tno) nsiz *= 2;
+
+    if (_task_l_resize(ctx, *lsiz, nsiz) != MP_ok) return MP_mem;
+    *lsiz = nsiz;
+    return MP_ok;
+}
+
+/* Sparse mode. Each task number takes the next free slot of the task list
+ * the first time it is met, as a task or as a successor, so the successors are
+ * stored as slots right away. Slot 0 is kept for task number 0, as 0 marks a
+ * missing successor. The index maps the task numbers to their slots, flagged
+ * with MP_SLOT_DEF once the task itself is read. */
+#define MP_SLOT_DEF (~(TaskNo)0 ^ (~(TaskNo)0 >> 1))
+
+static MPRes _sparse_reserve(MParser *ctx, unsigned long *lsiz, TaskNo slot)
+{
+    if (slot < *lsiz) return MP_ok;
+
+    unsigned long osiz = *lsiz;
+    MPRes res = _task_l_reserve(ctx, lsiz, slot);
+    if (res != MP_ok) return res;
+
+    TaskNo *ntl = realloc(ctx->tno_l, *lsiz * sizeof(*ntl));
+    if (!ntl) {
+        *lsiz = osiz;
+        return MP_mem;
+    }
+    ctx->tno_l = ntl;
+    return MP_ok;
+}
+
+/* @return pointer to the index entry of task number 'tno', taking a new slot
+ *  if needed, or NULL on memory allocation failure. The pointer is valid until
+ *  the next call. */
+static TaskNo *_sparse_slot(
+    MParser *ctx,
+    ulmap *idx,
+    unsigned long *lsiz,
+    TaskNo tno)
+{
+    TaskNo *slotp = ulmap_put(idx, tno);
+    if (!slotp) return NULL;
+
+    if (!*slotp) {
+        if (_sparse_reserve(ctx, lsiz, ctx->task_llen) != MP_ok) return NULL;
+        ctx->tno_l[ctx->task_llen] = tno;
+        *slotp = ctx->task_llen++;
+    }
+    return slotp;
+}
+
+/* A slot taken by a successor keeps the line and the file of this first
+ * reference in its task entry until the task is read, so that a dangling
+ * reference can be located, see _sparse_finish(). */
+static inline void _sparse_ref(
+    MParser *ctx,
+    TaskNo slot,
+    unsigned long lno,
+    unsigned fno)
+{
+    if (ctx->flags & MPF_columnar) {
+        ctx->cols.req[slot] = lno;
+        ctx->cols.pno[slot] = fno;
+    } else {
+        ctx->task_l[slot].lno = lno;
+        ctx->task_l[slot].pno = fno;
+    }
+}
+
+/* Store task 'ct' into the slot of task number 'tno'. The successors of 'ct'
+ * are translated into slots.
+ * @param idx index of the slots by task number
+ * @param defcnt number of tasks read so far, updated
+ * @param fno index of the file of 'ct', file list mode */
+static MPRes _sparse_put(
+    MParser *ctx,
+    ulmap *idx,
+    unsigned long *lsiz,
+    unsigned long *defcnt,
+    TaskNo tno,
+    MPTask *ct,
+    unsigned fno)
+{
+    TaskNo *slotp;
+    TaskNo slot = 0;
+
+    for (int k = 0; k < 2; k++) {
+        if (!ct->next[k]) continue;
+        unsigned long len = ctx->task_llen;
+        if (!(slotp = _sparse_slot(ctx, idx, lsiz, ct->next[k]))) return MP_mem;
+        ct->next[k] = *slotp & ~MP_SLOT_DEF;
+        if (ctx->task_llen != len) _sparse_ref(ctx, ct->next[k], ct->lno, fno);
+    }
+
+    if (tno) {
+        if (!(slotp = _sparse_slot(ctx, idx, lsiz, tno))) return MP_mem;
+        if (!(*slotp & MP_SLOT_DEF)) (*defcnt)++;
+        *slotp |= MP_SLOT_DEF;
+        slot = *slotp & ~MP_SLOT_DEF;
+    }
+
+    return _task_put(ctx, slot, ct);
+}
+
+/* Complete a sparse task list: check that all the successors were read, set
+ * the head and trim the over-allocation.
+ * @return MP_ok on success, MP_err on dangling references (the first one is
+ *  found in 'err_lno' and 'err_fno') */
+static MPRes _sparse_finish(
+    MParser *ctx,
+    const ulmap *idx,
+    unsigned long lsiz,
+    unsigned long defcnt,
+    TaskNo tno_min)
+{
+    /* every slot but 0 belongs to a task read. The slots are taken in the
+     * order of the references, so the first one not read holds the first
+     * dangling reference, see _sparse_ref(). */
+    for (TaskNo slot = 1; defcnt != ctx->task_llen - 1; slot++) {
+        assert(slot < ctx->task_llen);
+        if (*(TaskNo*)ulmap_get(idx, ctx->tno_l[slot]) & MP_SLOT_DEF) continue;
+
+        if (ctx->flags & MPF_columnar) {
+            ctx->err_lno = ctx->cols.req[slot];
+            ctx->err_fno = ctx->cols.pno[slot];
+        } else {
+            ctx->err_lno = ctx->task_l[slot].lno;
+            ctx->err_fno = ctx->task_l[slot].pno;
+        }
+        printf("[Error][MP][parse] successor %lu not defined\n",
+            ctx->tno_l[slot]);
+        return MP_err;
+    }
+
+    ctx->head = tno_min ? *(TaskNo*)ulmap_get(idx, tno_min) & ~MP_SLOT_DEF : 0;
+
+    _task_l_resize(ctx, lsiz, ctx->task_llen);
+    TaskNo *ntnol = realloc(ctx->tno_l, ctx->task_llen * sizeof(*ntnol));
+    if (ntnol) ctx->tno_l = ntnol;
+    return MP_ok;
+}
+
+/* Prepare the context for a new sparse task list.
+ * @return index of the slots by task number, NULL on memory allocation
+ *  failure */
+static ulmap *_sparse_start(MParser *ctx, unsigned long *lsiz)
+{
+    _task_l_free(ctx);
+    free(ctx->tno_l);
+    ctx->tno_l = NULL;
+    ctx->task_llen = 1;
+    *lsiz = 0;
+
+    if (_sparse_reserve(ctx, lsiz, 0) != MP_ok) return NULL;
+    ctx->tno_l[0] = 0;
+    return ulmap_construct(sizeof(TaskNo), 1024);
+}
+
+/* Start the parsing of the model. In sparse mode (see MPF_sparse), the
+ * task numbers gathered by MParser_init() are ignored.
  * @param ctx the context to be parsed
- * @return MP_ok on success, MP_err on file corruption or IO error */
+ * @return MP_ok on success, MP_err on file corruption or IO error, MP_mem on
+ *  memory allocation issues */
 MPRes MParser_parse(MParser *ctx)
 {
     assert(ctx);
@@ -82,96 +616,1422 @@ MPRes MParser_parse(MParser *ctx)
     char linebuf[2048];
     MPTask ct;
     TaskNo tno;
-    int lp, lpt, conv_cnt;
-    int lno = 1;
+    TaskNo tno_min = ULONG_MAX;
+    unsigned long lno = 0;
+    unsigned long lsiz;
+    unsigned long defcnt = 0;
+    ulmap *idx = NULL;
+    MPRes res = MP_ok;
+
+    if (ctx->flags & MPF_sparse) {
+        if (!(idx = _sparse_start(ctx, &lsiz))) return MP_mem;
+    } else {
+        _task_l_free(ctx);
+        if (_task_l_resize(ctx, 0, ctx->task_llen) != MP_ok) return MP_mem;
+    }
 
     rewind(ctx->src);
 
     while (fgets(linebuf, 2048, ctx->src)) {
-//        printf("lno: %d\n", lno++);
-        lp = 0;
-        if (linebuf[0] < '0' || linebuf[0] > '9') continue;
-
-        ct = task_empty;
+        lno++;
+        int pres = _parse_line(linebuf, linebuf + strlen(linebuf), &tno, &ct);
+        if (pres == 0) continue;
+        if (pres < 0) {
+            ctx->err_lno = lno;
+            res = MP_err;
+            break;
+        }
         ct.lno = lno;
 
-        conv_cnt = sscanf(linebuf, "%lu %d %d %lu%n",
-            &tno, &ct.pno, (int*)&ct.ttype, &ct.mem, &lpt);
-        if (conv_cnt != 4)
+        if (idx) {
+            res = _sparse_put(ctx, idx, &lsiz, &defcnt, tno, &ct, 0);
+            if (res != MP_ok) break;
+            if (tno < tno_min) tno_min = tno;
+            continue;
+        }
+
+        if (tno >= ctx->task_llen || ct.next[0] >= ctx->task_llen ||
+            ct.next[1] >= ctx->task_llen || _task_put(ctx, tno, &ct) != MP_ok) {
+            ctx->err_lno = lno;
             return MP_err;
+        }
+    }
 
-        lp += lpt;
+    if (idx) {
+        if (res == MP_ok && tno_min == ULONG_MAX) res = MP_err;
+        if (res == MP_ok)
+            res = _sparse_finish(ctx, idx, lsiz, defcnt, tno_min);
+        ulmap_destroy(idx);
+    }
 
-        switch (ct.ttype) {
-        case MPTT_start:
-        case MPTT_forkend:
-        case MPTT_join:
-            conv_cnt = sscanf(linebuf + lp, " -> %lu", &ct.next[0]);
-            if (conv_cnt != 1)
-                return MP_err;
-            break;
+    return res;
+}
 
-        case MPTT_end:
-            //printf("end\n");
-            break;
+/* Map file 'fname' read-only into 'mp'.
+ * @return MP_ok on success, MP_err on IO error or empty file */
+static MPRes _map_file(const char *fname, MPMap *mp)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) return MP_err;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return MP_err;
+    }
+
+    void *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) return MP_err;
+    madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+    mp->buf = buf;
+    mp->len = st.st_size;
+
+    return MP_ok;
+}
+
+/* Init a context for parsing a memory-mapped PPM model file. Unlike
+ * MParser_init(), the file is not scanned here; the task list is allocated
+ * and grown by MParser_parse_mmap(), which reads the file only once.
+ * @param ctx pointer to parsing context
+ * @param fname path of the model file
+ * @param cap_val_com cap the weights of the communication tasks. Set to -1 for
+ *  no capping
+ * @param cap_val_cal cap the weights of the calculation tasks. Set to -1 for no
+ *  capping
+ * @return MP_ok on success, MP_err on IO error or empty file */
+MPRes MParser_init_mmap(
+    MParser *ctx,
+    const char *fname,
+    double cap_val_com,
+    double cap_val_cal)
+{
+    assert(ctx && fname);
+    *ctx = mparser_empty;
+
+    ctx->cap_val_cal = cap_val_cal < 0 ? DBL_MAX : cap_val_cal;
+    ctx->cap_val_com = cap_val_com < 0 ? DBL_MAX : cap_val_com;
+
+    return _map_file(fname, &ctx->map);
+}
+
+/* @return end of the line starting at 'lp', excluding the line break */
+static inline const char *_line_end(const char *lp, const char *end)
+{
+    const char *eol = memchr(lp, '\n', end - lp);
+    return eol ? eol : end;
+}
+
+static double _elapsed(const struct timespec *ts_start)
+{
+    struct timespec ts_end;
+    clock_gettime(CLOCK_MONOTONIC, &ts_end);
+    return (ts_end.tv_sec - ts_start->tv_sec) +
+        (ts_end.tv_nsec - ts_start->tv_nsec) * 1e-9;
+}
+
+/* Reference to a successor */
+typedef struct {
+    TaskNo          next;
+    unsigned long   lno;
+} MPRef;
+
+/* Single-pass construction of the task list, which grows as the tasks are
+ * read. */
+typedef struct {
+    unsigned long   lsiz;
+    /* sparse mode */
+    ulmap           *idx;
+    unsigned long   defcnt;
+    TaskNo          tno_min;
+    TaskNo          tno_max;
+    TaskNo          next_max;
+    /* dense mode: the references past the last task number read so far,
+     * those of increasing successors only, at [refi, refcnt). A dangling
+     * reference is past the last task number of all, so the first one is
+     * kept. */
+    MPRef           *refl;
+    unsigned long   refi;
+    unsigned long   refcnt;
+    unsigned long   refsiz;
+} MPGrow;
+
+static MPRes _grow_start(MParser *ctx, MPGrow *gp)
+{
+    *gp = (MPGrow){ .tno_min = ULONG_MAX };
+
+    if ((ctx->flags & MPF_sparse) && !(gp->idx = _sparse_start(ctx, &gp->lsiz)))
+        return MP_mem;
+    return MP_ok;
+}
+
+/* Drop the references of a growing task list up to the last task number read
+ * so far, see MPGrow. */
+static inline void _grow_ref_drop(MPGrow *gp)
+{
+    while (gp->refi < gp->refcnt && gp->refl[gp->refi].next <= gp->tno_max)
+        gp->refi++;
+    if (gp->refi == gp->refcnt) gp->refi = gp->refcnt = 0;
+}
+
+/* Keep the references of task 'ct' past the last task number read so far, see
+ * MPGrow. */
+static inline MPRes _grow_ref(MPGrow *gp, const MPTask *ct)
+{
+    _grow_ref_drop(gp);
+
+    for (int k = 0; k < 2; k++) {
+        TaskNo next = ct->next[k];
+        if (next <= gp->tno_max) continue;
+        if (gp->refcnt && next <= gp->refl[gp->refcnt - 1].next) continue;
 
-        case MPTT_fork:
-            conv_cnt = sscanf(linebuf + lp, " -> %lu %*u %*u -> %lu",
-                &ct.next[0], &ct.next[1]);
-            if (conv_cnt != 2) {
-                if (conv_cnt < 1) {
-                    return MP_err;
-                }
-                /* empty fork */
-                ct.next[1] = 0;
+        if (gp->refcnt == gp->refsiz) {
+            if (gp->refi) {
+                memmove(gp->refl, gp->refl + gp->refi,
+                    (gp->refcnt - gp->refi) * sizeof(*gp->refl));
+                gp->refcnt -= gp->refi;
+                gp->refi = 0;
+            } else {
+                unsigned long nsiz = gp->refsiz ? gp->refsiz * 2 : 16;
+                MPRef *nrefl = realloc(gp->refl, nsiz * sizeof(*nrefl));
+                if (!nrefl) return MP_mem;
+                gp->refl = nrefl;
+                gp->refsiz = nsiz;
             }
-            break;
+        }
+        gp->refl[gp->refcnt++] = (MPRef){ .next = next, .lno = ct->lno };
+    }
+    return MP_ok;
+}
 
-        case MPTT_calc:
-            conv_cnt = sscanf(linebuf + lp, " %lf -> %lu",
-                &ct.req, &ct.next[0]);
-            if (conv_cnt != 2)
-                return MP_err;
-            break;
+static inline MPRes _grow_put(MParser *ctx, MPGrow *gp, TaskNo tno, MPTask *ct)
+{
+    MPRes res;
 
-        case MPTT_com:
-            conv_cnt = sscanf(linebuf + lp, " %lf -- %lu%n",
-                &ct.req, &ct.dest, &lpt);
-            if (conv_cnt != 2)
-                return MP_err;
-            lp += lpt;
-
-            /* dest == 0 => broadcast */
-            conv_cnt = sscanf(linebuf + lp,
-                ct.dest == 0 ? " -> %lu" : "  %*u %*u -> %lu" , &ct.next[0]);
-            if (conv_cnt != 1)
-                return MP_err;
-            break;
+    if (gp->idx) {
+        res = _sparse_put(ctx, gp->idx, &gp->lsiz, &gp->defcnt, tno, ct, 0);
+    } else {
+        res = _task_l_reserve(ctx, &gp->lsiz, tno);
+        if (res == MP_ok) res = _task_put(ctx, tno, ct);
+        if (ct->next[0] > gp->next_max) gp->next_max = ct->next[0];
+        if (ct->next[1] > gp->next_max) gp->next_max = ct->next[1];
+    }
+    if (res == MP_err) ctx->err_lno = ct->lno;
 
-        default:
-            return MP_err;
+    if (tno > gp->tno_max) gp->tno_max = tno;
+    if (tno < gp->tno_min) gp->tno_min = tno;
+    /* in resumable mode, the references not read are counted as pending */
+    if (res == MP_ok && !gp->idx && !ctx->resume) res = _grow_ref(gp, ct);
+    return res;
+}
+
+/* Complete the task list once all the tasks are read.
+ * @param res result of the reading phase
+ * @return final result of the parsing */
+static MPRes _grow_finish(MParser *ctx, MPGrow *gp, MPRes res)
+{
+    /* invalid file */
+    if (res == MP_ok && gp->tno_max < gp->tno_min) res = MP_err;
+
+    if (gp->idx) {
+        if (res == MP_ok)
+            res = _sparse_finish(ctx, gp->idx, gp->lsiz, gp->defcnt, gp->tno_min);
+        ulmap_destroy(gp->idx);
+        return res;
+    }
+
+    /* dangling references */
+    if (res == MP_ok && gp->next_max > gp->tno_max) {
+        _grow_ref_drop(gp);
+        assert(gp->refi < gp->refcnt);
+        ctx->err_lno = gp->refl[gp->refi].lno;
+        printf("[Error][MP][parse] successor %lu not defined\n",
+            gp->refl[gp->refi].next);
+        res = MP_err;
+    }
+    free(gp->refl);
+    gp->refl = NULL;
+
+    if (res == MP_ok) {
+        ctx->head = gp->tno_min;
+        ctx->task_llen = gp->tno_max + 1;
+        /* trim the over-allocation of the growing phase */
+        _task_l_resize(ctx, gp->lsiz, ctx->task_llen);
+    }
+    return res;
+}
+
+/* Binary model format, see MPBinHeader */
+
+/* @return whether the mapped file is a binary model */
+static int _bin_is(const MPMap *mp)
+{
+    return mp->len >= sizeof(MP_BIN_MAGIC) - 1 &&
+        !memcmp(mp->buf, MP_BIN_MAGIC, sizeof(MP_BIN_MAGIC) - 1);
+}
+
+static inline uint64_t _zz_enc(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t _zz_dec(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline unsigned char *_bin_put_uvar(unsigned char *p, uint64_t v)
+{
+    for (; v >= 0x80; v >>= 7) *p++ = v | 0x80;
+    *p++ = v;
+    return p;
+}
+
+/* @return pointer past the varint, NULL if it is truncated or too long */
+static inline const unsigned char *_bin_uvar(
+    const unsigned char *p,
+    const unsigned char *end,
+    uint64_t *val)
+{
+    if (p < end && *p < 0x80) {
+        *val = *p;
+        return p + 1;
+    }
 
+    uint64_t v = 0;
+    for (unsigned sh = 0; p < end && sh < 64; sh += 7) {
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7f) << sh;
+        if (!(b & 0x80)) {
+            *val = v;
+            return p;
         }
+    }
+    return NULL;
+}
 
-        if (tno >= ctx->task_llen)
-            return MP_err;
-        if (ct.next[0] >= ctx->task_llen)
-            return MP_err;
-        if (ct.next[1] >= ctx->task_llen)
-            return MP_err;
-        ctx->task_l[tno] = ct;
+/* Decode a task record.
+ * @param tno previous task number, replaced by the one of the record
+ * @return pointer past the record, NULL on corruption */
+static inline const unsigned char *_bin_task(
+    const unsigned char *p,
+    const unsigned char *end,
+    TaskNo *tno,
+    MPTask *ct)
+{
+    uint64_t v;
+
+    *ct = task_empty;
+
+    if (!(p = _bin_uvar(p, end, &v)) || p == end) return NULL;
+    *tno += _zz_dec(v);
+    ct->ttype = *p++;
+    if (!(p = _bin_uvar(p, end, &v))) return NULL;
+    ct->pno = _zz_dec(v);
+    if (!(p = _bin_uvar(p, end, &v))) return NULL;
+    ct->mem = v;
+
+    switch (ct->ttype) {
+    case MPTT_start:
+    case MPTT_end:
+    case MPTT_fork:
+    case MPTT_join:
+    case MPTT_forkend:
+        break;
+
+    case MPTT_calc:
+    case MPTT_com:
+        if (end - p < (ptrdiff_t)sizeof(ct->req)) return NULL;
+        memcpy(&ct->req, p, sizeof(ct->req));
+        p += sizeof(ct->req);
+        if (ct->ttype == MPTT_com) {
+            if (!(p = _bin_uvar(p, end, &v))) return NULL;
+            ct->dest = v;
+        }
+        break;
+
+    default:
+        return NULL;
     }
 
-    return MP_ok;
+    if (ct->ttype != MPTT_end) {
+        if (!(p = _bin_uvar(p, end, &v))) return NULL;
+        ct->next[0] = *tno + _zz_dec(v);
+    }
+    if (ct->ttype == MPTT_fork) {
+        if (!(p = _bin_uvar(p, end, &v))) return NULL;
+        ct->next[1] = *tno + _zz_dec(v);
+    }
+
+    return p;
 }
 
-/* Deinit a parsing context
- * @param ctx pointer to parsing context
- * @return MP_ok is always returned*/
-MPRes MParser_deinit(MParser *ctx)
+/* Load a binary model file (see MParser_export_bin()) previously mapped by
+ * MParser_init_mmap(). MParser_parse_mmap() calls it for binary files. The
+ * resulting context state is the same as after parsing the text model.
+ * @param ctx the context to be loaded
+ * @return MP_ok on success, MP_err on file corruption (the number of the
+ *  offending record is found in 'err_lno'), MP_mem on memory allocation
+ *  issues */
+MPRes MParser_parse_bin(MParser *ctx)
 {
-    assert(ctx);
-    free(ctx->task_l);
+    assert(ctx && ctx->map.buf);
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+    MPBinHeader hdr;
+    if (ctx->map.len < sizeof(hdr)) return MP_err;
+    memcpy(&hdr, ctx->map.buf, sizeof(hdr));
+    if (memcmp(hdr.magic, MP_BIN_MAGIC, sizeof(hdr.magic)) ||
+        hdr.bom != MP_BIN_BOM || hdr.version != MP_BIN_VERSION) {
+        printf("[Error][MP][parse_bin] not a binary model of this version "
+            "and byte order\n");
+        return MP_err;
+    }
+
+    MPTask ct;
+    TaskNo tno = 0;
+    MPGrow grow;
+    MPRes res = _grow_start(ctx, &grow);
+    if (res != MP_ok) return res;
+
+    /* the task list size is known, if the task numbers are dense */
+    if (!grow.idx && hdr.tno_max / 2 <= hdr.task_cnt) {
+        res = _task_l_resize(ctx, 0, hdr.tno_max + 1);
+        if (res != MP_ok) return res;
+        grow.lsiz = hdr.tno_max + 1;
+    }
+
+    const unsigned char *p = (const unsigned char*)ctx->map.buf + sizeof(hdr);
+    const unsigned char *end = (const unsigned char*)ctx->map.buf +
+        ctx->map.len;
+
+    for (uint64_t n = 1; n <= hdr.task_cnt; n++) {
+        if (!(p = _bin_task(p, end, &tno, &ct))) {
+            ctx->err_lno = n;
+            res = MP_err;
+            break;
+        }
+        ct.lno = n;
+
+        res = _grow_put(ctx, &grow, tno, &ct);
+        if (res != MP_ok) break;
+    }
+    /* trailing data */
+    if (res == MP_ok && p != end) res = MP_err;
+
+    res = _grow_finish(ctx, &grow, res);
+
+    ctx->stat_bytes = ctx->map.len;
+    ctx->stat_sec = _elapsed(&ts_start);
+
+    return res;
+}
+
+/* @return whether the task list index 'i' holds a task. Only the start task
+ * has the type of the zeroed entries. */
+static inline int _task_defined(const MParser *ctx, TaskNo i, const MPTask *ct)
+{
+    return ct->ttype != MPTT_start || i == ctx->head;
+}
+
+/* Export a parsed model in the binary format (see MPBinHeader), which is
+ * loaded much faster than the text format. The task records are written in
+ * task list order. With MPF_columnar, the fields not stored are written as
+ * zero.
+ * @param ctx the parsed context
+ * @param dst destination file, does not need to be seekable
+ * @return MP_ok on success, MP_err on IO error */
+MPRes MParser_export_bin(const MParser *ctx, FILE *dst)
+{
+    assert(ctx && dst);
+
+    MPBinHeader hdr = {
+        .bom = MP_BIN_BOM,
+        .version = MP_BIN_VERSION,
+        .tno_min = ULONG_MAX
+    };
+    memcpy(hdr.magic, MP_BIN_MAGIC, sizeof(hdr.magic));
+
+    for (TaskNo i = 0; i < ctx->task_llen; i++) {
+        MPTask ct = MParser_get_task(ctx, i);
+        if (!_task_defined(ctx, i, &ct)) continue;
+        TaskNo tno = MParser_tno(ctx, i);
+        hdr.task_cnt++;
+        if (tno < hdr.tno_min) hdr.tno_min = tno;
+        if (tno > hdr.tno_max) hdr.tno_max = tno;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, dst) != 1) return MP_err;
+
+    /* large enough for the longest record */
+    unsigned char rec[96];
+    TaskNo tno_prev = 0;
+    for (TaskNo i = 0; i < ctx->task_llen; i++) {
+        MPTask ct = MParser_get_task(ctx, i);
+        if (!_task_defined(ctx, i, &ct)) continue;
+        TaskNo tno = MParser_tno(ctx, i);
+
+        unsigned char *p = rec;
+        p = _bin_put_uvar(p, _zz_enc(tno - tno_prev));
+        *p++ = ct.ttype;
+        p = _bin_put_uvar(p, _zz_enc(ct.pno));
+        p = _bin_put_uvar(p, ct.mem);
+        if (ct.ttype == MPTT_calc || ct.ttype == MPTT_com) {
+            memcpy(p, &ct.req, sizeof(ct.req));
+            p += sizeof(ct.req);
+        }
+        if (ct.ttype == MPTT_com) p = _bin_put_uvar(p, ct.dest);
+        if (ct.ttype != MPTT_end)
+            p = _bin_put_uvar(p, _zz_enc(MParser_tno(ctx, ct.next[0]) - tno));
+        if (ct.ttype == MPTT_fork)
+            p = _bin_put_uvar(p, _zz_enc(MParser_tno(ctx, ct.next[1]) - tno));
+
+        if (fwrite(rec, p - rec, 1, dst) != 1) return MP_err;
+        tno_prev = tno;
+    }
+
+    return MP_ok;
+}
+
+/* Parse a model file previously mapped by MParser_init_mmap() in a single
+ * pass. The resulting context state is the same as after MParser_init() and
+ * MParser_parse(). Binary model files are loaded by MParser_parse_bin().
+ * @param ctx the context to be parsed
+ * @return MP_ok on success, MP_err on file corruption, MP_mem on memory
+ *  allocation issues */
+MPRes MParser_parse_mmap(MParser *ctx)
+{
+    assert(ctx && ctx->map.buf);
+
+    if (_bin_is(&ctx->map)) return MParser_parse_bin(ctx);
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+    MPTask ct;
+    TaskNo tno;
+    unsigned long lno = 0;
+    MPGrow grow;
+    MPRes res = _grow_start(ctx, &grow);
+    if (res != MP_ok) return res;
+
+    const char *lp = ctx->map.buf;
+    const char *end = lp + ctx->map.len;
+
+    for (const char *eol; lp < end; lp = eol + (eol < end)) {
+        eol = _line_end(lp, end);
+        lno++;
+
+        int pres = _parse_line(lp, eol, &tno, &ct);
+        if (pres == 0) continue;
+        if (pres < 0) {
+            ctx->err_lno = lno;
+            res = MP_err;
+            break;
+        }
+        ct.lno = lno;
+
+        res = _grow_put(ctx, &grow, tno, &ct);
+        if (res != MP_ok) break;
+    }
+
+    res = _grow_finish(ctx, &grow, res);
+
+    ctx->stat_bytes = ctx->map.len;
+    ctx->stat_sec = _elapsed(&ts_start);
+
+    return res;
+}
+
+typedef struct {
+    TaskNo  tno;
+    MPTask  task;
+} MPChunkTask;
+
+/* A newline-aligned part of a mapped file, parsed by one thread. */
+typedef struct {
+    MParser         *ctx;
+    const char      *beg;
+    const char      *end;
+    MPChunkTask     *task_l;
+    unsigned long   task_cnt;
+    unsigned long   task_lsiz;
+    /* number of lines in the chunk */
+    unsigned long   lcnt;
+    /* line number of the first line of the chunk, minus one */
+    unsigned long   lno_off;
+    /* index of the file of the chunk */
+    unsigned        fno;
+    TaskNo          tno_min;
+    TaskNo          tno_max;
+    TaskNo          next_max;
+    /* 1 + index of the last chunk defining each task number, shared by all
+     * the chunks, see _chunk_own() */
+    uint32_t        *owner;
+    uint32_t        id;
+    /* check the links, see _chunk_check() */
+    int             check;
+    /* line number of the first offending task */
+    unsigned long   err_lno;
+    MPRes           res;
+} MPChunk;
+
+static void *_chunk_parse(void *arg)
+{
+    MPChunk *chp = arg;
+    MPChunkTask ct;
+
+    chp->tno_min = ULONG_MAX;
+
+    const char *lp = chp->beg;
+    for (const char *eol; lp < chp->end; lp = eol + (eol < chp->end)) {
+        eol = _line_end(lp, chp->end);
+        chp->lcnt++;
+
+        int pres = _parse_line(lp, eol, &ct.tno, &ct.task);
+        if (pres == 0) continue;
+        if (pres < 0) {
+            /* keep the line count at the failing line */
+            chp->res = MP_err;
+            return NULL;
+        }
+        /* chunk-local, offset once all the chunks are counted */
+        ct.task.lno = chp->lcnt;
+
+        if (chp->task_cnt == chp->task_lsiz) {
+            unsigned long nsiz = chp->task_lsiz ? chp->task_lsiz * 2 : 1024;
+            MPChunkTask *ntl = realloc(chp->task_l, nsiz * sizeof(*ntl));
+            if (!ntl) {
+                chp->res = MP_mem;
+                return NULL;
+            }
+            chp->task_l = ntl;
+            chp->task_lsiz = nsiz;
+        }
+        chp->task_l[chp->task_cnt++] = ct;
+
+        if (ct.tno > chp->tno_max) chp->tno_max = ct.tno;
+        if (ct.tno < chp->tno_min) chp->tno_min = ct.tno;
+        if (ct.task.next[0] > chp->next_max) chp->next_max = ct.task.next[0];
+        if (ct.task.next[1] > chp->next_max) chp->next_max = ct.task.next[1];
+    }
+
+    chp->res = MP_ok;
+    return NULL;
+}
+
+/* Claim the task numbers of the chunk before the scattering. A task number
+ * defined by several chunks is owned by the last one, as the serial parsers
+ * keep the last definition, and only the owner writes the task. */
+static void *_chunk_own(void *arg)
+{
+    MPChunk *chp = arg;
+
+    chp->res = MP_ok;
+    for (unsigned long i = 0; i < chp->task_cnt; i++) {
+        MPChunkTask *ctp = &chp->task_l[i];
+        ctp->task.lno += chp->lno_off;
+
+        uint32_t *ownerp = &chp->owner[ctp->tno];
+        uint32_t prev = __atomic_load_n(ownerp, __ATOMIC_RELAXED);
+        while (prev < chp->id && !__atomic_compare_exchange_n(ownerp, &prev,
+                chp->id, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+
+        /* defined twice within the chunk. Across chunks, the chunk not
+         * owning the task notices in _chunk_check(). */
+        if (chp->check && prev == chp->id && chp->res == MP_ok) {
+            printf("[Error][MP][parse] task %lu defined twice\n", ctp->tno);
+            chp->err_lno = ctp->task.lno;
+            chp->res = MP_err;
+        }
+    }
+    return NULL;
+}
+
+/* Write the tasks owned by the chunk into the task list, once all the chunks
+ * are claimed. Within the chunk, the last definition is written last. */
+static void *_chunk_scatter(void *arg)
+{
+    MPChunk *chp = arg;
+
+    chp->res = MP_ok;
+    for (unsigned long i = 0; i < chp->task_cnt; i++) {
+        MPChunkTask *ctp = &chp->task_l[i];
+        if (chp->owner[ctp->tno] != chp->id) continue;
+        if (_task_put(chp->ctx, ctp->tno, &ctp->task) != MP_ok &&
+            chp->res == MP_ok) {
+            chp->err_lno = ctp->task.lno;
+            chp->res = MP_err;
+        }
+    }
+
+    /* kept for the link check */
+    if (chp->check) return NULL;
+    free(chp->task_l);
+    chp->task_l = NULL;
+    return NULL;
+}
+
+/* Check that the tasks of the chunk are not defined by another chunk, and
+ * that their successors are defined, once all the chunks are scattered. */
+static void *_chunk_check(void *arg)
+{
+    MPChunk *chp = arg;
+
+    for (unsigned long i = 0; i < chp->task_cnt && chp->res == MP_ok; i++) {
+        MPChunkTask *ctp = &chp->task_l[i];
+        if (chp->owner[ctp->tno] != chp->id) {
+            printf("[Error][MP][parse] task %lu defined twice\n", ctp->tno);
+            chp->err_lno = ctp->task.lno;
+            chp->res = MP_err;
+        }
+        for (int k = 0; k < 2; k++) {
+            TaskNo next = ctp->task.next[k];
+            if (!next || chp->owner[next]) continue;
+            printf("[Error][MP][parse] task %lu: successor %lu not defined\n",
+                ctp->tno, next);
+            chp->err_lno = ctp->task.lno;
+            chp->res = MP_err;
+        }
+    }
+
+    free(chp->task_l);
+    chp->task_l = NULL;
+    return NULL;
+}
+
+typedef struct {
+    MPChunk         *chunk_l;
+    unsigned        cnt;
+    unsigned        next;
+    void            *(*fn)(void*);
+} MPChunkQueue;
+
+static void *_chunk_worker(void *arg)
+{
+    MPChunkQueue *qp = arg;
+    unsigned i;
+
+    while ((i = __atomic_fetch_add(&qp->next, 1, __ATOMIC_RELAXED)) < qp->cnt)
+        qp->fn(&qp->chunk_l[i]);
+    return NULL;
+}
+
+/* Run 'fn' on all the chunks, using up to 'nthreads' threads including the
+ * calling one. The threads take the chunks in order, one at a time. */
+static MPRes _chunk_run(
+    MPChunk *chunk_l,
+    unsigned cnt,
+    unsigned nthreads,
+    void *(*fn)(void*))
+{
+    MPChunkQueue queue = { chunk_l, cnt, 0, fn };
+    if (nthreads > cnt) nthreads = cnt;
+
+    pthread_t *thr_l = malloc(nthreads * sizeof(*thr_l));
+    if (!thr_l) return MP_mem;
+
+    unsigned started;
+    for (started = 1; started < nthreads; started++) {
+        if (pthread_create(&thr_l[started], NULL, _chunk_worker, &queue))
+            break;
+    }
+    _chunk_worker(&queue);
+    for (unsigned i = 1; i < started; i++)
+        pthread_join(thr_l[i], NULL);
+
+    free(thr_l);
+    return MP_ok;
+}
+
+/* Store the tasks of all the chunks into a sparse task list, in file order.
+ * @param check detect the task numbers defined twice */
+static MPRes _chunk_sparse(
+    MParser *ctx,
+    MPChunk *chunk_l,
+    unsigned cnt,
+    TaskNo tno_min,
+    int check)
+{
+    unsigned long lsiz;
+    unsigned long defcnt = 0;
+    ulmap *idx = _sparse_start(ctx, &lsiz);
+    MPRes res = idx ? MP_ok : MP_mem;
+
+    for (unsigned i = 0; i < cnt && res == MP_ok; i++) {
+        MPChunk *chp = &chunk_l[i];
+        for (unsigned long k = 0; k < chp->task_cnt && res == MP_ok; k++) {
+            MPChunkTask *ctp = &chp->task_l[k];
+            unsigned long defcnt_prev = defcnt;
+            ctp->task.lno += chp->lno_off;
+            res = _sparse_put(
+                ctx, idx, &lsiz, &defcnt, ctp->tno, &ctp->task, chp->fno);
+            if (res == MP_err) {
+                ctx->err_lno = ctp->task.lno;
+                ctx->err_fno = chp->fno;
+            }
+            if (res == MP_ok && check && ctp->tno && defcnt == defcnt_prev) {
+                printf("[Error][MP][parse] task %lu defined twice\n", ctp->tno);
+                ctx->err_lno = ctp->task.lno;
+                ctx->err_fno = chp->fno;
+                res = MP_err;
+            }
+        }
+        free(chp->task_l);
+        chp->task_l = NULL;
+    }
+
+    if (res == MP_ok) {
+        res = _sparse_finish(ctx, idx, lsiz, defcnt, tno_min);
+        if (res != MP_ok && check)
+            printf("[Error][MP][parse] successors not defined\n");
+    }
+
+    ulmap_destroy(idx);
+    return res;
+}
+
+/* @return the first chunk failing a pass, after setting the error location
+ *  in the context, or NULL */
+static MPChunk *_chunk_failed(MParser *ctx, MPChunk *chunk_l, unsigned cnt)
+{
+    for (unsigned i = 0; i < cnt; i++) {
+        if (chunk_l[i].res == MP_ok) continue;
+        ctx->err_lno = chunk_l[i].err_lno;
+        ctx->err_fno = chunk_l[i].fno;
+        return &chunk_l[i];
+    }
+    return NULL;
+}
+
+/* Locate the first reference past the last task number in the chunks, which
+ * are not scattered yet, in 'err_lno' and 'err_fno'. */
+static void _chunk_dangling(
+    MParser *ctx,
+    const MPChunk *chunk_l,
+    unsigned cnt,
+    TaskNo tno_max)
+{
+    for (unsigned i = 0; i < cnt; i++) {
+        const MPChunk *chp = &chunk_l[i];
+        for (unsigned long k = 0; k < chp->task_cnt; k++) {
+            const MPTask *ctp = &chp->task_l[k].task;
+            for (int n = 0; n < 2; n++) {
+                if (ctp->next[n] <= tno_max) continue;
+                ctx->err_lno = ctp->lno + chp->lno_off;
+                ctx->err_fno = chp->fno;
+                printf("[Error][MP][parse] successor %lu not defined\n",
+                    ctp->next[n]);
+                return;
+            }
+        }
+    }
+}
+
+/* Parse mapped files using multiple threads. Each file is split at line
+ * boundaries into chunks, about 'nthreads' in total. Each thread parses
+ * chunks into private lists, then, once the size of the task list is known,
+ * scatters them into the task list. The resulting context state is the same
+ * as after MParser_parse_mmap() on the concatenated files, with the line
+ * numbers counted per file.
+ * @param check check that all the successors are defined and that no task
+ *  number is defined twice
+ * @return see MParser_parse_mmap_mt() */
+static MPRes _chunks_parse(
+    MParser *ctx,
+    const MPMap *map_l,
+    unsigned map_cnt,
+    unsigned nthreads,
+    int check)
+{
+    size_t total = 0;
+    for (unsigned f = 0; f < map_cnt; f++) total += map_l[f].len;
+
+    /* at least one chunk per file */
+    unsigned cnt = 0;
+    for (unsigned f = 0; f < map_cnt; f++)
+        cnt += (map_l[f].len * nthreads + total - 1) / total + 1;
+
+    MPChunk *chunk_l = calloc(cnt, sizeof(*chunk_l));
+    if (!chunk_l) return MP_mem;
+
+    cnt = 0;
+    for (unsigned f = 0; f < map_cnt; f++) {
+        unsigned fcnt = (map_l[f].len * nthreads + total - 1) / total;
+        if (!fcnt) fcnt = 1;
+
+        const char *beg = map_l[f].buf;
+        const char *end = beg + map_l[f].len;
+        for (unsigned i = 0; i < fcnt; i++) {
+            const char *cend = i == fcnt - 1 ?
+                end : map_l[f].buf + map_l[f].len / fcnt * (i + 1);
+            if (cend < beg) cend = beg;
+            if (cend < end) {
+                /* align to the start of the next line */
+                cend = memchr(cend, '\n', end - cend);
+                cend = cend ? cend + 1 : end;
+            }
+
+            chunk_l[cnt].ctx = ctx;
+            chunk_l[cnt].beg = beg;
+            chunk_l[cnt].end = cend;
+            chunk_l[cnt].fno = f;
+            cnt++;
+            beg = cend;
+        }
+    }
+
+    MPRes res = _chunk_run(chunk_l, cnt, nthreads, _chunk_parse);
+
+    TaskNo tno_max = 0;
+    TaskNo tno_min = ULONG_MAX;
+    TaskNo next_max = 0;
+    unsigned long lno_off = 0;
+    for (unsigned i = 0; i < cnt && res == MP_ok; i++) {
+        MPChunk *chp = &chunk_l[i];
+        if (i && chp->fno != chunk_l[i - 1].fno) lno_off = 0;
+        chp->lno_off = lno_off;
+        lno_off += chp->lcnt;
+
+        res = chp->res;
+        if (res == MP_err) {
+            ctx->err_lno = lno_off;
+            ctx->err_fno = chp->fno;
+        }
+        if (res != MP_ok) break;
+
+        if (chp->task_cnt == 0) continue;
+        if (chp->tno_max > tno_max) tno_max = chp->tno_max;
+        if (chp->tno_min < tno_min) tno_min = chp->tno_min;
+        if (chp->next_max > next_max) next_max = chp->next_max;
+    }
+
+    /* invalid file */
+    if (res == MP_ok && tno_max < tno_min) res = MP_err;
+
+    if (res == MP_ok && (ctx->flags & MPF_sparse)) {
+        res = _chunk_sparse(ctx, chunk_l, cnt, tno_min, check);
+        goto out;
+    }
+
+    /* dangling references */
+    if (res == MP_ok && next_max > tno_max) {
+        _chunk_dangling(ctx, chunk_l, cnt, tno_max);
+        res = MP_err;
+    }
+
+    uint32_t *owner = NULL;
+    if (res == MP_ok) {
+        owner = calloc(tno_max + 1, sizeof(*owner));
+        if (!owner) res = MP_mem;
+        for (unsigned i = 0; i < cnt; i++) {
+            chunk_l[i].owner = owner;
+            chunk_l[i].id = i + 1;
+            chunk_l[i].check = check;
+        }
+    }
+
+    if (res == MP_ok) {
+        res = _chunk_run(chunk_l, cnt, nthreads, _chunk_own);
+        if (res == MP_ok && _chunk_failed(ctx, chunk_l, cnt)) res = MP_err;
+    }
+
+    if (res == MP_ok) {
+        _task_l_free(ctx);
+        res = _task_l_resize(ctx, 0, tno_max + 1);
+    }
+
+    if (res == MP_ok) {
+        ctx->head = tno_min;
+        ctx->task_llen = tno_max + 1;
+        res = _chunk_run(chunk_l, cnt, nthreads, _chunk_scatter);
+        if (res == MP_ok && _chunk_failed(ctx, chunk_l, cnt)) res = MP_err;
+    }
+
+    if (res == MP_ok && check) {
+        res = _chunk_run(chunk_l, cnt, nthreads, _chunk_check);
+        if (res == MP_ok && _chunk_failed(ctx, chunk_l, cnt)) res = MP_err;
+    }
+    free(owner);
+
+out:
+    for (unsigned i = 0; i < cnt; i++)
+        free(chunk_l[i].task_l);
+    free(chunk_l);
+
+    return res;
+}
+
+/* Parse a model file previously mapped by MParser_init_mmap() using multiple
+ * threads. The file is split at line boundaries into one chunk per thread.
+ * Each thread parses its chunk into a private list, then, once the size of
+ * the task list is known, scatters it into the task list. The resulting
+ * context state is the same as after MParser_parse_mmap(), line numbers
+ * included. Peak memory is about twice the size of the task list.
+ * @param ctx the context to be parsed
+ * @param nthreads number of threads. 0 selects the number of online CPUs.
+ * @return MP_ok on success, MP_err on file corruption (the offending line is
+ *  found in 'err_lno'), MP_mem on memory allocation issues */
+MPRes MParser_parse_mmap_mt(MParser *ctx, unsigned nthreads)
+{
+    assert(ctx && ctx->map.buf);
+
+    if (nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? ncpu : 1;
+    }
+    if (nthreads == 1 || _bin_is(&ctx->map)) return MParser_parse_mmap(ctx);
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+    MPRes res = _chunks_parse(ctx, &ctx->map, 1, nthreads, 0);
+
+    ctx->stat_bytes = ctx->map.len;
+    ctx->stat_sec = _elapsed(&ts_start);
+
+    return res;
+}
+
+/* Init a context for parsing a model split into several files, e.g. one per
+ * MPI rank, see MParser_parse_files(). The files are memory-mapped.
+ * @param ctx pointer to parsing context
+ * @param fname_l paths of the model files
+ * @param fcnt number of files
+ * @param cap_val_com cap the weights of the communication tasks. Set to -1 for
+ *  no capping
+ * @param cap_val_cal cap the weights of the calculation tasks. Set to -1 for no
+ *  capping
+ * @return MP_ok on success, MP_err on IO error, empty or binary file (the
+ *  index of the file is found in 'err_fno'), MP_mem on memory allocation
+ *  issues */
+MPRes MParser_init_files(
+    MParser *ctx,
+    const char *const *fname_l,
+    unsigned fcnt,
+    double cap_val_com,
+    double cap_val_cal)
+{
+    assert(ctx && fname_l && fcnt);
+    *ctx = mparser_empty;
+
+    ctx->cap_val_cal = cap_val_cal < 0 ? DBL_MAX : cap_val_cal;
+    ctx->cap_val_com = cap_val_com < 0 ? DBL_MAX : cap_val_com;
+
+    ctx->map_l = calloc(fcnt, sizeof(*ctx->map_l));
+    if (!ctx->map_l) return MP_mem;
+
+    for (; ctx->map_cnt < fcnt; ctx->map_cnt++) {
+        MPMap *mp = &ctx->map_l[ctx->map_cnt];
+        ctx->err_fno = ctx->map_cnt;
+        if (_map_file(fname_l[ctx->map_cnt], mp) != MP_ok) return MP_err;
+        if (_bin_is(mp)) {
+            printf("[Error][MP][init_files] %s: binary models cannot be "
+                "merged\n", fname_l[ctx->map_cnt]);
+            ctx->map_cnt++;
+            return MP_err;
+        }
+    }
+    ctx->err_fno = 0;
+
+    return MP_ok;
+}
+
+/* Init a context for parsing a model split into several files, see
+ * MParser_init_files(). The files are those matching 'pattern', in
+ * alphabetical order.
+ * @param pattern glob pattern, e.g. "trace/rank*.txt"
+ * @return MP_ok on success, MP_err on IO error or if no file matches, MP_mem
+ *  on memory allocation issues */
+MPRes MParser_init_glob(
+    MParser *ctx,
+    const char *pattern,
+    double cap_val_com,
+    double cap_val_cal)
+{
+    assert(ctx && pattern);
+    *ctx = mparser_empty;
+
+    glob_t gl;
+    int gres = glob(pattern, 0, NULL, &gl);
+    if (gres == GLOB_NOSPACE) return MP_mem;
+    if (gres) return MP_err;
+
+    MPRes res = MParser_init_files(ctx, (const char *const *)gl.gl_pathv,
+        gl.gl_pathc, cap_val_com, cap_val_cal);
+    globfree(&gl);
+
+    return res;
+}
+
+/* Parse a model split into several files, previously mapped by
+ * MParser_init_files() or MParser_init_glob(), using multiple threads. The
+ * files are parsed concurrently (see MParser_parse_mmap_mt()) and merged into
+ * one task list, the same as parsing their concatenation, in the given order.
+ * As the successors may be defined by any file, the merged task list is
+ * checked: every successor must be defined, and no task number may be defined
+ * twice.
+ * @param ctx the context to be parsed
+ * @param nthreads number of threads. 0 selects the number of online CPUs.
+ * @return MP_ok on success, MP_err on file corruption (the offending line is
+ *  found in 'err_lno', its file in 'err_fno') or failed check, MP_mem on
+ *  memory allocation issues */
+MPRes MParser_parse_files(MParser *ctx, unsigned nthreads)
+{
+    assert(ctx && ctx->map_l);
+
+    if (nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? ncpu : 1;
+    }
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+    MPRes res = _chunks_parse(ctx, ctx->map_l, ctx->map_cnt, nthreads, 1);
+
+    ctx->stat_bytes = 0;
+    for (unsigned f = 0; f < ctx->map_cnt; f++)
+        ctx->stat_bytes += ctx->map_l[f].len;
+    ctx->stat_sec = _elapsed(&ts_start);
+
+    return res;
+}
+
+/* Init a context for reading a PPM model file as a stream of tasks, see
+ * MParser_stream_next(). No task list is allocated; the file is read once,
+ * block by block, so it does not need to be seekable. Files compressed with
+ * gzip or zstd are detected by their magic bytes and inflated in a background
+ * thread.
+ * @param ctx pointer to parsing context
+ * @param src source file pointer
+ * @param cap_val_com cap the weights of the communication tasks. Set to -1 for
+ *  no capping
+ * @param cap_val_cal cap the weights of the calculation tasks. Set to -1 for no
+ *  capping
+ * @return MP_ok on success, MP_err on IO error or unsupported compression
+ *  format, MP_mem on memory allocation issues */
+MPRes MParser_init_stream(
+    MParser *ctx,
+    FILE *src,
+    double cap_val_com,
+    double cap_val_cal)
+{
+    assert(ctx && src);
+    *ctx = mparser_empty;
+
+    ctx->src = src;
+    ctx->cap_val_cal = cap_val_cal < 0 ? DBL_MAX : cap_val_cal;
+    ctx->cap_val_com = cap_val_com < 0 ? DBL_MAX : cap_val_com;
+
+    MPStream *sp = &ctx->stream;
+    sp->siz = MP_STREAM_BUFSIZ;
+    sp->buf = malloc(sp->siz);
+    if (!sp->buf) return MP_mem;
+
+    /* the magic bytes are inflated or parsed, there is no rewind */
+    size_t rcnt = fread(sp->buf, 1, MP_INFL_MAGIC_LEN, src);
+    if (ferror(src)) return MP_err;
+
+    MPZFormat fmt = MPInflater_detect(sp->buf, rcnt);
+    if (fmt != MPZ_none)
+        return MPInflater_create(&ctx->infl, src, fmt, sp->buf, rcnt);
+
+    sp->len = rcnt;
+    ctx->stat_bytes = rcnt;
+
+    return MP_ok;
+}
+
+/* Refill the read buffer, keeping its unparsed data. The buffer grows if the
+ * unparsed data fills it, i.e. a line is longer than the buffer. */
+static MPRes _stream_fill(MParser *ctx)
+{
+    MPStream *sp = &ctx->stream;
+
+    memmove(sp->buf, sp->buf + sp->pos, sp->len - sp->pos);
+    sp->len -= sp->pos;
+    sp->pos = 0;
+
+    if (sp->len == sp->siz) {
+        char *nbuf = realloc(sp->buf, sp->siz * 2);
+        if (!nbuf) return MP_mem;
+        sp->buf = nbuf;
+        sp->siz *= 2;
+    }
+
+    size_t rcnt;
+    if (ctx->infl) {
+        MPRes res = MPInflater_read(
+            ctx->infl, sp->buf + sp->len, sp->siz - sp->len, &rcnt);
+        if (res != MP_ok) return res;
+    } else {
+        rcnt = fread(sp->buf + sp->len, 1, sp->siz - sp->len, ctx->src);
+        if (rcnt == 0 && ferror(ctx->src)) return MP_err;
+    }
+    if (rcnt == 0) sp->eof = 1;
+    sp->len += rcnt;
+    ctx->stat_bytes += rcnt;
+
+    return MP_ok;
+}
+
+/* Read the next task of a model opened by MParser_init_stream(). The tasks
+ * are returned in file order.
+ * @param ctx pointer to parsing context
+ * @param tno where the task number is stored
+ * @param task where the task is stored
+ * @return MP_ok if a task was read, MP_eof at the end of the file, MP_err on
+ *  IO error or file corruption (the offending line is found in 'err_lno'),
+ *  MP_mem on memory allocation issues */
+MPRes MParser_stream_next(MParser *ctx, TaskNo *tno, MPTask *task)
+{
+    assert(ctx && ctx->stream.buf && tno && task);
+    MPStream *sp = &ctx->stream;
+
+    while (1) {
+        const char *lp = sp->buf + sp->pos;
+        const char *end = sp->buf + sp->len;
+        const char *eol = memchr(lp, '\n', end - lp);
+
+        if (!eol) {
+            if (!sp->eof) {
+                MPRes res = _stream_fill(ctx);
+                if (res != MP_ok) return res;
+                continue;
+            }
+            /* last line, not terminated. In resumable mode, it may still be
+             * being written. */
+            if (lp == end || ctx->resume) return MP_eof;
+            eol = end;
+        }
+
+        sp->pos = eol - sp->buf + (eol < end);
+        sp->lno++;
+
+        int pres = _parse_line(lp, eol, tno, task);
+        if (pres == 0) continue;
+        if (pres < 0) {
+            ctx->err_lno = sp->lno;
+            return MP_err;
+        }
+        task->lno = sp->lno;
+        return MP_ok;
+    }
+}
+
+/* Parse a model opened by MParser_init_stream() in a single pass, e.g. a
+ * compressed one. The resulting context state is the same as after
+ * MParser_init() and MParser_parse().
+ * @param ctx the context to be parsed
+ * @return MP_ok on success, MP_err on IO error or file corruption, MP_mem on
+ *  memory allocation issues */
+MPRes MParser_parse_stream(MParser *ctx)
+{
+    assert(ctx && ctx->stream.buf);
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+    MPTask ct;
+    TaskNo tno;
+    MPGrow grow;
+    MPRes res = _grow_start(ctx, &grow);
+    if (res != MP_ok) return res;
+
+    while ((res = MParser_stream_next(ctx, &tno, &ct)) == MP_ok) {
+        res = _grow_put(ctx, &grow, tno, &ct);
+        if (res != MP_ok) break;
+    }
+    if (res == MP_eof) res = MP_ok;
+
+    res = _grow_finish(ctx, &grow, res);
+
+    ctx->stat_sec = _elapsed(&ts_start);
+
+    return res;
+}
+
+/* Resumable mode state, see MParser_update() */
+struct MPResume {
+    MPGrow          grow;
+    int             started;
+    /* dense layout: MP_MARK_* flags of each task number */
+    uint8_t         *mark;
+    unsigned long   marksiz;
+};
+
+enum {
+    /* the task is read */
+    MP_MARK_DEF     = 0x1,
+    /* the task is the successor of a task read */
+    MP_MARK_REF     = 0x2
+};
+
+static MPRes _mark_reserve(MPResume *rp, TaskNo tno)
+{
+    if (tno < rp->marksiz) return MP_ok;
+
+    unsigned long nsiz = rp->marksiz ? rp->marksiz : 1024;
+    while (nsiz <= tno) nsiz *= 2;
+
+    uint8_t *nmark = realloc(rp->mark, nsiz);
+    if (!nmark) return MP_mem;
+    memset(nmark + rp->marksiz, 0, nsiz - rp->marksiz);
+    rp->mark = nmark;
+    rp->marksiz = nsiz;
+    return MP_ok;
+}
+
+/* Dense layout: account for a task read, and for its successors, in the
+ * number of pending successors. */
+static MPRes _mark_task(MParser *ctx, TaskNo tno, const MPTask *ct)
+{
+    MPResume *rp = ctx->resume;
+
+    if (_mark_reserve(rp, tno) != MP_ok) return MP_mem;
+    if (!(rp->mark[tno] & MP_MARK_DEF)) {
+        if (rp->mark[tno] & MP_MARK_REF) ctx->pending--;
+        rp->mark[tno] |= MP_MARK_DEF;
+    }
+
+    for (int k = 0; k < 2; k++) {
+        TaskNo next = ct->next[k];
+        if (!next) continue;
+        if (_mark_reserve(rp, next) != MP_ok) return MP_mem;
+        if (rp->mark[next]) continue;
+        rp->mark[next] = MP_MARK_REF;
+        ctx->pending++;
+    }
+    return MP_ok;
+}
+
+/* Init a context for parsing a model file that is still growing, e.g. written
+ * by a running job. Each call to MParser_update() parses the lines appended
+ * since the previous one and extends the task list.
+ * @param ctx pointer to parsing context
+ * @param src source file pointer, kept open between the updates. It does not
+ *  need to be seekable.
+ * @param cap_val_com cap the weights of the communication tasks. Set to -1 for
+ *  no capping
+ * @param cap_val_cal cap the weights of the calculation tasks. Set to -1 for no
+ *  capping
+ * @return MP_ok on success, MP_mem on memory allocation issues */
+MPRes MParser_init_resumable(
+    MParser *ctx,
+    FILE *src,
+    double cap_val_com,
+    double cap_val_cal)
+{
+    assert(ctx && src);
+    *ctx = mparser_empty;
+
+    ctx->src = src;
+    ctx->cap_val_cal = cap_val_cal < 0 ? DBL_MAX : cap_val_cal;
+    ctx->cap_val_com = cap_val_com < 0 ? DBL_MAX : cap_val_com;
+
+    ctx->resume = calloc(1, sizeof(*ctx->resume));
+    if (!ctx->resume) return MP_mem;
+
+    ctx->stream.siz = MP_STREAM_BUFSIZ;
+    ctx->stream.buf = malloc(ctx->stream.siz);
+    if (!ctx->stream.buf) return MP_mem;
+
+    return MP_ok;
+}
+
+/* Parse the lines appended to a model file opened by MParser_init_resumable()
+ * since the previous call, and extend the task list, whose state is then the
+ * same as after parsing the whole file with MParser_parse(). A line is only
+ * parsed once terminated. The mode flags may be set before the first call.
+ * As the file is incomplete, the successors of a task may not be read yet;
+ * their number is found in 'pending', and the task list can be used to build
+ * a PPM once it is zero.
+ * @param ctx the context to be updated
+ * @return MP_ok on success, MP_err on IO error or file corruption (the
+ *  offending line is found in 'err_lno'), MP_mem on memory allocation
+ *  issues */
+MPRes MParser_update(MParser *ctx)
+{
+    assert(ctx && ctx->resume);
+    MPResume *rp = ctx->resume;
+    MPGrow *gp = &rp->grow;
+    MPStream *sp = &ctx->stream;
+
+    struct timespec ts_start;
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+    MPRes res;
+    if (!rp->started) {
+        res = _grow_start(ctx, gp);
+        if (res != MP_ok) return res;
+        rp->started = 1;
+    }
+
+    /* read past the previous end of the file */
+    sp->eof = 0;
+    clearerr(ctx->src);
+    ctx->stat_bytes = 0;
+
+    MPTask ct;
+    TaskNo tno;
+    while ((res = MParser_stream_next(ctx, &tno, &ct)) == MP_ok) {
+        if (!gp->idx && (res = _mark_task(ctx, tno, &ct)) != MP_ok) break;
+        res = _grow_put(ctx, gp, tno, &ct);
+        if (res != MP_ok) break;
+    }
+    if (res == MP_eof) res = MP_ok;
+
+    /* make the tasks read so far available, keeping the over-allocation of
+     * the task list for the next update */
+    if (gp->tno_max >= gp->tno_min) {
+        if (gp->idx) {
+            ctx->head = gp->tno_min ?
+                *(TaskNo*)ulmap_get(gp->idx, gp->tno_min) & ~MP_SLOT_DEF : 0;
+            ctx->pending = ctx->task_llen - 1 - gp->defcnt;
+        } else {
+            ctx->head = gp->tno_min;
+            ctx->task_llen = gp->tno_max + 1;
+        }
+    }
+
+    ctx->stat_sec = _elapsed(&ts_start);
+
+    return res;
+}
+
+/* @param ctx pointer to parsing context
+ * @return throughput of the last parsing pass in MB/s, 0 if unknown */
+double MParser_throughput(const MParser *ctx)
+{
+    assert(ctx);
+    if (ctx->stat_sec <= 0.0) return 0.0;
+    return ctx->stat_bytes / ctx->stat_sec / 1e6;
+}
+
+/* Deinit a parsing context
+ * @param ctx pointer to parsing context
+ * @return MP_ok is always returned*/
+MPRes MParser_deinit(MParser *ctx)
+{
+    assert(ctx);
+    _task_l_free(ctx);
+    free(ctx->tno_l);
+    MPInflater_destroy(ctx->infl);
+    free(ctx->stream.buf);
+    if (ctx->map.buf)
+        munmap((void*)ctx->map.buf, ctx->map.len);
+    for (unsigned f = 0; f < ctx->map_cnt; f++)
+        munmap((void*)ctx->map_l[f].buf, ctx->map_l[f].len);
+    free(ctx->map_l);
+    if (ctx->resume) {
+        if (ctx->resume->grow.idx) ulmap_destroy(ctx->resume->grow.idx);
+        free(ctx->resume->mark);
+        free(ctx->resume);
+    }
     return MP_ok;
 }
 
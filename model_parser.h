@@ -19,12 +19,16 @@
 #define MODEL_PARSER_H_
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "TaskSegRaw.h"
 
 typedef enum {
     MP_ok,
     MP_mem,
-    MP_err
+    MP_err,
+    /* end of the model reached, streaming mode */
+    MP_eof
 } MPRes;
 
 typedef unsigned long TaskNo;
@@ -54,14 +58,113 @@ typedef struct {
     unsigned long lno;
 } MPTask;
 
+typedef struct {
+    /* file contents, mapped read-only */
+    const char      *buf;
+    size_t          len;
+} MPMap;
+
+/* parsing mode flags */
+enum {
+    /* Store the tasks densely, in file order, instead of indexing the task
+     * list by task number. For models with sparse or offset task numbers.
+     * The successors ('next') hold task list indices, and the task number of
+     * each index is found in 'tno_l' (see MParser_tno()). */
+    MPF_sparse      = 0x1,
+    /* Store the task list in columns (see MPCols) instead of 'task_l'. Use
+     * MParser_get_task() to read it. The task list indices must fit in 32
+     * bits. */
+    MPF_columnar    = 0x2
+};
+
+/* Columnar task list. Only the fields needed to build the PPM are stored,
+ * with narrow types. The 'mem', 'dest' and 'lno' columns are only filled by a
+ * parser compiled with MP_COLS_DEBUG, they are NULL otherwise. */
+typedef struct {
+    uint8_t         *ttype;
+    int32_t         *pno;
+    double          *req;
+    uint32_t        (*next)[2];
+    unsigned long   *mem;
+    unsigned long   *dest;
+    unsigned long   *lno;
+} MPCols;
+
+/* maximum number of columns */
+#define MP_COLS_MAX 7
+
+/* read buffer of the streaming mode. Unparsed data is buf[pos, len). */
+typedef struct {
+    char            *buf;
+    size_t          siz;
+    size_t          pos;
+    size_t          len;
+    /* number of lines read so far */
+    unsigned long   lno;
+    int             eof;
+} MPStream;
+
+/* Binary model format, see MParser_export_bin(). The header is followed by
+ * 'task_cnt' records, one per task:
+ *  - task number, as zigzag varint of its difference to the previous one
+ *  - task type, one byte
+ *  - process number as zigzag varint, memory as varint
+ *  - calc and com: weight, raw double
+ *  - com: destination, varint
+ *  - all but end: next[0], fork: next[1], as zigzag varints of their
+ *    difference to the task number
+ * Varints are LEB128. The header fields and the weights are in host byte
+ * order, which is checked through 'bom'. */
+#define MP_BIN_MAGIC    "PPMB"
+#define MP_BIN_BOM      0x01020304u
+#define MP_BIN_VERSION  1u
+
+typedef struct {
+    char            magic[4];
+    uint32_t        bom;
+    uint32_t        version;
+    uint32_t        reserved;
+    uint64_t        task_cnt;
+    uint64_t        tno_min;
+    uint64_t        tno_max;
+} MPBinHeader;
+
+struct MPInflater;
+typedef struct MPResume MPResume;
+
 typedef struct {
     FILE            *src;
+    MPMap           map;
+    /* file list mode: one mapping per file */
+    MPMap           *map_l;
+    unsigned        map_cnt;
+    MPStream        stream;
+    /* streaming mode: decompressor of a compressed source file, or NULL */
+    struct MPInflater *infl;
+    /* resumable mode: parsing state between the updates, or NULL */
+    MPResume        *resume;
     MPTask          *task_l;
+    MPCols          cols;
     unsigned long   task_llen;
+    /* sparse mode: task number of each task list index */
+    TaskNo          *tno_l;
+    /* MPF_* flags, set before parsing */
+    unsigned        flags;
     TaskNo          head;
     TaskNo          cti;        /*  */
     double          cap_val_com;
     double          cap_val_cal;
+    /* line number of the first corrupt line, set when parsing fails */
+    unsigned long   err_lno;
+    /* file list mode: index of the file of 'err_lno' */
+    unsigned        err_fno;
+    /* statistics of the last parsing pass */
+    size_t          stat_bytes;
+    double          stat_sec;
+    /* streaming mode: peak number of tasks read ahead of their predecessor */
+    unsigned long   stat_window;
+    /* resumable mode: number of successors referenced but not read yet */
+    unsigned long   pending;
 } MParser;
 
 
@@ -71,5 +174,71 @@ MPRes MParser_init(
     double cap_val_com,
     double cap_val_cal);
 MPRes   MParser_parse(MParser *ctx);
+MPRes MParser_init_mmap(
+    MParser *ctx,
+    const char *fname,
+    double cap_val_com,
+    double cap_val_cal);
+MPRes   MParser_parse_mmap(MParser *ctx);
+MPRes   MParser_parse_mmap_mt(MParser *ctx, unsigned nthreads);
+MPRes MParser_init_files(
+    MParser *ctx,
+    const char *const *fname_l,
+    unsigned fcnt,
+    double cap_val_com,
+    double cap_val_cal);
+MPRes MParser_init_glob(
+    MParser *ctx,
+    const char *pattern,
+    double cap_val_com,
+    double cap_val_cal);
+MPRes   MParser_parse_files(MParser *ctx, unsigned nthreads);
+MPRes   MParser_parse_bin(MParser *ctx);
+MPRes   MParser_export_bin(const MParser *ctx, FILE *dst);
+double  MParser_throughput(const MParser *ctx);
+MPRes MParser_init_stream(
+    MParser *ctx,
+    FILE *src,
+    double cap_val_com,
+    double cap_val_cal);
+MPRes   MParser_stream_next(MParser *ctx, TaskNo *tno, MPTask *task);
+MPRes   MParser_parse_stream(MParser *ctx);
+MPRes MParser_init_resumable(
+    MParser *ctx,
+    FILE *src,
+    double cap_val_com,
+    double cap_val_cal);
+MPRes   MParser_update(MParser *ctx);
 MPRes   MParser_deinit(MParser *ctx);
+
+/* @return task at index 'i' of the task list, whatever its layout. With
+ *  MPF_columnar, the fields not stored are zero.
+ * @param ctx pointer to parsing context
+ * @param i index in the task list */
+static inline MPTask MParser_get_task(const MParser *ctx, TaskNo i)
+{
+    if (!(ctx->flags & MPF_columnar)) return ctx->task_l[i];
+
+    const MPCols *cols = &ctx->cols;
+    MPTask task = {
+        .pno = cols->pno[i],
+        .ttype = cols->ttype[i],
+        .req = cols->req[i],
+        .next = { cols->next[i][0], cols->next[i][1] }
+    };
+    if (cols->lno) {
+        task.mem = cols->mem[i];
+        task.dest = cols->dest[i];
+        task.lno = cols->lno[i];
+    }
+    return task;
+}
+
+/* @return task number of the task at index 'i' of the task list
+ * @param ctx pointer to parsing context
+ * @param i index in the task list */
+static inline TaskNo MParser_tno(const MParser *ctx, TaskNo i)
+{
+    return ctx->tno_l ? ctx->tno_l[i] : i;
+}
 #endif
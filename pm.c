@@ -16,19 +16,17 @@
  * */
 
 #include "pm.h"
+#include <pthread.h>
 #include <gsl/gsl_statistics_double.h>
 
 /* Status bits for all vertex types*/
 #define PMV_SBIT_evaluated             0x0001
-#define PMV_SBIT_commonstem_start_1    0x0002
-#define PMV_SBIT_commonstem_start_2    0x0004
 
 /* Status bits for inosculation vertices */
 #define PMV_SBIT_INSC_is_sym           0x0200
 
 static const PMContext pmcontext_zero = { 0 };
 //static const CPMVContext cpmvcontext_zero = { 0 };
-static const PMV pmv_zero = { 0 };
 
 #define BIG_C_RAD (2.0)
 #define SMOL_C_RAD (0.5)
@@ -36,6 +34,22 @@ static const PMV pmv_zero = { 0 };
 #define X_SPACE (BIG_C_RAD * 2)
 #define VERY_BIG_NUM (10e6)
 
+/* number of vertices or groups allocated at once */
+#define PMV_SLAB_CHUNK 4096
+
+/* A class of trees, see PMV.cls: the root vertex type and the classes of the
+ * trees the root points to. */
+typedef struct {
+    uint32_t type;
+    /* first branch: parent or wrapped */
+    uint32_t b1;
+    /* child branch */
+    uint32_t b2;
+    uint32_t np;
+} PMVClass;
+
+static const PMVClass pmvclass_zero = { 0 };
+
 typedef enum {
     Cstr_ralign,
     Cstr_lalign
@@ -87,12 +101,16 @@ static void PMVG_deinit(Object *objp);
 static PMV *PMV_create(PMContext *ctx, PMVType type, PMV **prevnpp);
 static int PMVG_addv(PMVG *gp, PMV *vp);
 static void PMV_eval_r(PMV *vp, char force);
-static int PMVG_merge(PMVG *to, PMVG *from);
-static PMV* _build_graph(
+typedef struct PMBTask PMBTask;
+typedef struct PMHashCons PMHashCons;
+static int _build_graph(
     MParser *parsctx,
+    TaskNo *ctip,
     PMContext *pmctx,
     PMV **prevnpp,
-    TaskSegRawCtx *tsrctx);
+    TaskSegRawCtx *tsrctx,
+    PMHashCons *hcp,
+    PMBTask *taskp);
 
 
 const PMVG_VMT PMVG_vmt = {
@@ -110,6 +128,18 @@ PMContext *PMContext_create(void)
     assert(PMVGCtx_init(&pmctx->gctx) == 0);
     pmctx->segcontl = arll_construct(sizeof(Segcont), 64);
     assert(pmctx->segcontl);
+    pmctx->pmv_slab = slab_construct(sizeof(PMV), PMV_SLAB_CHUNK);
+    assert(pmctx->pmv_slab);
+    pmctx->pmvg_slab = slab_construct(sizeof(PMVG), PMV_SLAB_CHUNK);
+    assert(pmctx->pmvg_slab);
+    pmctx->gmergedl = arll_construct(sizeof(PMVG*), 64);
+    assert(pmctx->gmergedl);
+    pmctx->clsl = arll_construct(sizeof(PMVClass), 1024);
+    assert(pmctx->clsl);
+    /* class 0 is the empty tree */
+    assert(arll_push(pmctx->clsl, &pmvclass_zero) != -1);
+    pmctx->clsm = ulmap_construct(sizeof(uint32_t), 1024);
+    assert(pmctx->clsm);
 
     return pmctx;
 }
@@ -141,8 +171,8 @@ static int PMVG_init(PMContext *ctx, PMVG *gp, PMVType type)
 
     assert(gp);
     _obj_vmtp(gp) = (Object_VMT*)&PMVG_vmt;
-    gp->vpl = arll_construct(sizeof(PMV*), 1);
-    assert(gp->vpl);
+    gp->vpl = &gp->_vpl;
+    arll_init_buf(gp->vpl, sizeof(PMV*), gp->_vpl_buf, PMVG_VPL_BUFLEN);
     gp->id = ctx->gctx.gid_curr++;
     gp->cpmv.type = type;
 
@@ -152,81 +182,322 @@ static void PMVG_deinit(Object *objp)
 {
     if (!objp) return;
     PMVG *gp = (PMVG*)objp;
-    arll_destroy(gp->vpl);
+    arll_deinit(gp->vpl);
 
     _Elem_deinit(objp);
 }
 
+/* @return the PM context of a group */
+static inline PMContext *_PMVG_pmctx(PMVG *gp)
+{
+    return (PMContext*)((char*)gp->_super.ctxp - offsetof(PMContext, gctx));
+}
+
 static int PMVG_addv(PMVG *gp, PMV *vp)
 {
     assert(gp && vp);
     assert(vp->type == gp->cpmv.type);
-    return arll_push(gp->vpl, &vp) == -1 ? -1 : 0;
+    if (arll_push(gp->vpl, &vp) == -1) return -1;
+    gp->size++;
+    return 0;
+}
+
+/* Drop the frozen layout of the tree, which no longer matches it. */
+static void PMContext_thaw(PMContext *ctx)
+{
+    PMFrozen *fzp = ctx->frozen;
+    if (!fzp) return;
+    free(fzp->shape);
+    free(fzp->end);
+    free(fzp->gpl);
+    free(fzp->vpl);
+    free(fzp->segl);
+    free(fzp->clsoff);
+    free(fzp->clsv);
+    free(fzp);
+    ctx->frozen = NULL;
+}
+
+/* Drop the groups of the frozen layout only, the tree itself is left as it is
+ * by group merges. */
+static void PMContext_thaw_groups(PMContext *ctx)
+{
+    PMFrozen *fzp = ctx->frozen;
+    if (!fzp) return;
+    free(fzp->gpl);
+    fzp->gpl = NULL;
+}
+
+/* The steps of a vertex during a walk */
+typedef enum {
+    PMWS_br1,
+    PMWS_br2,
+    PMWS_next,
+    PMWS_post
+} PMWStep;
+
+typedef struct {
+    PMV *vp;
+    PMWStep step;
+} PMWFrame;
+
+/* Walk the tree starting at 'vp': the vertex, its branches and the rest of its
+ * stem, depth-first, parent branch before child branch. For each vertex,
+ * 'pre' is called first, then the branches are walked and 'post' is called.
+ * Unless PMWF_next_first is set, the walk then goes on with the next vertex,
+ * as read after 'post' returns. The branches are also read only when they are
+ * walked, so the callbacks may modify the parts of the tree yet to be walked,
+ * as a recursive pass would. The depth of the tree only costs heap memory.
+ * @param walkp pointer to the walk, see struct PMWalk
+ * @param vp start vertex, can be NULL
+ * @return 0 if the whole tree was walked, PMW_stop if a callback ended the
+ *  walk */
+int PMV_walk(PMWalk *walkp, PMV *vp)
+{
+    assert(walkp);
+
+    PMWFrame buf[64];
+    arll stack;
+    arll_init_buf(&stack, sizeof(PMWFrame), buf, sizeof(buf) / sizeof(*buf));
+
+    const char next_first = walkp->flags & PMWF_next_first;
+    PMWFrame frame, *fp = NULL;
+    int topi = -1;
+    PMWRes res = PMW_cont;
+    /* vertex to enter, in a new frame or, if it goes on with a stem, in the
+     * current one. 'pre' is called before the frame is taken, so that a cut
+     * costs no frame. */
+    PMV *nvp = vp;
+    char stem = 0;
+
+    for (;;) {
+        if (nvp) {
+            assert((unsigned)nvp->type < PMV_enumsize);
+            res = walkp->pre ? walkp->pre(walkp, nvp) : PMW_cont;
+            if (res == PMW_stop) break;
+
+            if (res != PMW_cut) {
+                frame.vp = nvp;
+                frame.step = res == PMW_prune ? PMWS_next : PMWS_br1;
+                if (stem) {
+                    *fp = frame;
+                } else {
+                    topi = arll_push(&stack, &frame);
+                    assert(topi != -1);
+                    fp = arll_geti(&stack, topi);
+                }
+            } else if (stem) {
+                arll_pop(&stack, NULL);
+                fp = topi-- ? arll_geti(&stack, topi) : NULL;
+            }
+            nvp = NULL;
+            stem = 0;
+        }
+        if (!fp) break;
+
+        PMV *cvp = fp->vp;
+        switch (fp->step) {
+        case PMWS_br1:
+            fp->step = PMWS_br2;
+            if (cvp->type == PMV_insc)      nvp = cvp->pp;
+            else if (cvp->type == PMV_wrap) nvp = cvp->wp;
+            if (nvp) break;
+            /* fall through */
+        case PMWS_br2:
+            fp->step = PMWS_next;
+            if (cvp->type == PMV_insc)      nvp = cvp->cp;
+            if (nvp) break;
+            /* fall through */
+        case PMWS_next:
+            fp->step = PMWS_post;
+            if (next_first)                 nvp = cvp->np;
+            if (nvp) break;
+            /* fall through */
+        case PMWS_post:
+            walkp->_next_set = 0;
+            res = walkp->post ? walkp->post(walkp, cvp) : PMW_cont;
+            if (!next_first)
+                nvp = walkp->_next_set ? walkp->_nextp : cvp->np;
+
+            if (nvp) {
+                stem = 1;
+            } else {
+                arll_pop(&stack, NULL);
+                fp = topi-- ? arll_geti(&stack, topi) : NULL;
+            }
+            break;
+
+        default:
+            assert(0);
+        }
+        if (res == PMW_stop) break;
+    }
+
+    arll_deinit(&stack);
+    return res == PMW_stop ? PMW_stop : 0;
+}
+
+/* The hash of a stem is the sum of the hashes of its vertices, the i-th one
+ * multiplied by hstem^i. A wrapped section is thus spliced into its stem by
+ * shifting the rest of the stem by the length of the section, so that the
+ * hash does not see the wrappers. The hash of a vertex mixes its type with
+ * the hashes of its branches, in their roles. */
+
+/* odd, so that the shift does not lose bits */
+static const uint64_t hstem = 0x9e3779b97f4a7c15ULL;
+
+/* seeds of the vertex hashes, by type */
+static const uint64_t hseed[PMV_enumsize] = {
+    [PMV_seg]  = 0x2545f4914f6cdd1dULL,
+    [PMV_insc] = 0xd6e8feb86659fd93ULL
+};
+
+/* splitmix64 finalizer */
+static inline uint64_t _hmix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* @return hstem^n */
+static uint64_t _hshift(unsigned n)
+{
+    uint64_t r = 1, b = hstem;
+    for (; n; n >>= 1, b *= b)
+        if (n & 1) r *= b;
+    return r;
+}
+
+/* @return the id of a class, a new one if not known yet */
+static uint32_t _cls_intern(
+    PMContext *ctx,
+    uint32_t type,
+    uint32_t b1,
+    uint32_t b2,
+    uint32_t np)
+{
+    uint64_t h = _hmix(_hmix(_hmix((type + hseed[PMV_insc]) ^ b1) ^ b2) ^ np);
+
+    /* on hash collisions, the next key is tried */
+    for (;; h++) {
+        /* not a valid key */
+        if (h == (unsigned long)-1) h++;
+
+        uint32_t *idp = ulmap_get(ctx->clsm, h);
+        if (!idp) break;
+        PMVClass *clsp = arll_geti(ctx->clsl, *idp);
+        if (clsp->type == type && clsp->b1 == b1 && clsp->b2 == b2 &&
+            clsp->np == np)
+            return *idp;
+    }
+
+    PMVClass cls = { .type = type, .b1 = b1, .b2 = b2, .np = np };
+    int id = arll_push(ctx->clsl, &cls);
+    uint32_t *idp = ulmap_put(ctx->clsm, h);
+    if (id == -1 || !idp) {
+        printf("[Fatal][PMV][_cls_intern]: out of memory\n");
+        assert(0);
+    }
+    *idp = id;
+    return id;
 }
 
-static void PMV_eval_r(PMV *vp, char force) {
-    /* biggest prime leq (2^31 - 1) / 2 */
-    static const uint32_t hp = 0x7FffFFff;
+/* @return the class of the trees of class 'c' with the trees of class 'nc'
+ *  appended to their stem, as a wrapper does */
+static uint32_t _cls_concat(PMContext *ctx, uint32_t c, uint32_t nc)
+{
+    if (!nc) return c;
+
+    PMVClass buf[64];
+    arll stem;
+    arll_init_buf(&stem, sizeof(PMVClass), buf, sizeof(buf) / sizeof(*buf));
+    for (; c; c = ((PMVClass*)arll_geti(ctx->clsl, c))->np)
+        assert(arll_push(&stem, arll_geti(ctx->clsl, c)) != -1);
+
+    PMVClass cls;
+    while (!arll_pop(&stem, &cls))
+        nc = _cls_intern(ctx, cls.type, cls.b1, cls.b2, nc);
+    arll_deinit(&stem);
+    return nc;
+}
+
+/* @return the class of a tree, 0 if empty */
+static inline uint32_t _PMV_cls(const PMV *vp)
+{
+    return vp ? vp->cls : 0;
+}
+
+/* Evaluate a vertex whose branches and next vertex are already evaluated.
+ * @param next_only set if only the rest of the stem changed since the vertex
+ *  was last evaluated, which leaves its symmetry as it is */
+static void _PMV_eval(PMV *vp, char next_only) {
 
     assert(vp);
     assert((unsigned)vp->type < PMV_enumsize);
 
     unsigned max_depth = 0;
+    /* hash of the rest of the stem and its shift */
+    uint64_t nhash = 0;
+    unsigned nshift = 1;
     switch(vp->type) {
     case PMV_wrap:
         /* wrapper doesn't add */
         vp->hash = 0x0;
         vp->depth = 0;
         vp->vcnt = 0;
+        vp->stemlen = 0;
 
         if (vp->wp) {
-            if (force || !(vp->wp->flags & PMV_SBIT_evaluated)) {
-                PMV_eval_r(vp->wp, force);
-            }
+            assert(vp->wp->flags & PMV_SBIT_evaluated);
             vp->depth += vp->wp->depth;
             vp->vcnt += vp->wp->vcnt;
-            vp->hash += vp->wp->hash;
-            vp->hash %= hp;
+            vp->hash = vp->wp->hash;
+            vp->stemlen = vp->wp->stemlen;
         }
+        nshift = vp->stemlen;
         break;
 
     case PMV_insc:
-        vp->hash = 0x1 << 15;
         vp->depth = 1;
         vp->vcnt = 1;
+        vp->stemlen = 1;
 
+        uint64_t bhash = hseed[PMV_insc];
         if (vp->pp) {
-            if (force || !(vp->pp->flags & PMV_SBIT_evaluated)) {
-                PMV_eval_r(vp->pp, force);
-            }
+            assert(vp->pp->flags & PMV_SBIT_evaluated);
             max_depth = vp->pp->depth;
             vp->vcnt += vp->pp->vcnt;
-            vp->hash += vp->pp->hash;
-            vp->hash %= hp;
+            bhash = _hmix(bhash ^ vp->pp->hash);
         }
+        bhash = _hmix(bhash + 1);
 
         if (vp->cp) {
-            if (force || !(vp->cp->flags & PMV_SBIT_evaluated)) {
-                PMV_eval_r(vp->cp, force);
-            }
+            assert(vp->cp->flags & PMV_SBIT_evaluated);
             if (vp->cp->depth > max_depth)
                 max_depth = vp->cp->depth;
             
             vp->vcnt += vp->cp->vcnt;
-            vp->hash += vp->cp->hash;
-            vp->hash %= hp;
+            bhash = _hmix(bhash ^ vp->cp->hash);
         }
+        vp->hash = _hmix(bhash);
         vp->depth += max_depth;
 
+        if (next_only) break;
+        vp->flags &= ~PMV_SBIT_INSC_is_sym;
         if (PMV_is_similar(vp->pp, vp->cp, 1))
             vp->flags |= PMV_SBIT_INSC_is_sym;
 
         break;
 
     case PMV_seg:
-        vp->hash = 0x1;
+        vp->hash = hseed[PMV_seg];
         vp->depth = 1;
         vp->vcnt = 1;
+        vp->stemlen = 1;
 
         break;
 
@@ -235,24 +506,241 @@ static void PMV_eval_r(PMV *vp, char force) {
     }
 
     if (vp->np) {
-        if (force || !(vp->np->flags & PMV_SBIT_evaluated)) {
-            PMV_eval_r(vp->np, force);
-        }
+        assert(vp->np->flags & PMV_SBIT_evaluated);
         vp->depth += vp->np->depth;
         vp->vcnt += vp->np->vcnt;
-        vp->hash += vp->np->hash;
-        vp->hash %= hp;
+        vp->stemlen += vp->np->stemlen;
+        nhash = vp->np->hash;
     }
+    if (nhash)
+        vp->hash += (nshift == 1 ? hstem : _hshift(nshift)) * nhash;
+
+    if (vp->type == PMV_wrap)
+        vp->cls = _cls_concat(vp->ctxp, _PMV_cls(vp->wp), _PMV_cls(vp->np));
+    else if (vp->type == PMV_insc)
+        vp->cls = _cls_intern(vp->ctxp, PMV_insc,
+            _PMV_cls(vp->pp), _PMV_cls(vp->cp), _PMV_cls(vp->np));
+    else
+        vp->cls = _cls_intern(vp->ctxp, PMV_seg, 0, 0, _PMV_cls(vp->np));
     
     vp->flags |= PMV_SBIT_evaluated;
 }
 
+/* @return 1 if 'vp' is NULL or evaluated, 0 otherwise */
+static inline char _PMV_is_evaluated(const PMV *vp)
+{
+    return !vp || (vp->flags & PMV_SBIT_evaluated);
+}
+
+typedef struct {
+    PMV *rootp;
+    char force;
+} PMEval;
+
+static PMWRes _eval_pre(PMWalk *walkp, PMV *vp)
+{
+    PMEval *evp = walkp->arg;
+    if (vp != evp->rootp && !evp->force && _PMV_is_evaluated(vp))
+        return PMW_cut;
+    return PMW_cont;
+}
+
+static PMWRes _eval_post(PMWalk *walkp, PMV *vp)
+{
+    (void)walkp;
+    _PMV_eval(vp, 0);
+    return PMW_cont;
+}
+
+/* Evaluate the tree starting at 'vp': hash, depth and vertex count. Each
+ * vertex is evaluated after everything it points to.
+ * @param force also evaluate the vertices already evaluated */
+static void PMV_eval_r(PMV *vp, char force)
+{
+    assert(vp);
+    /* only the vertex itself is left, spare the walk */
+    if (!force && _PMV_is_evaluated(vp->np) && (vp->type == PMV_seg ||
+        (vp->type == PMV_wrap && _PMV_is_evaluated(vp->wp)) ||
+        (vp->type == PMV_insc && _PMV_is_evaluated(vp->pp) &&
+            _PMV_is_evaluated(vp->cp)))) {
+        _PMV_eval(vp, 0);
+        return;
+    }
+
+    PMEval ev = { .rootp = vp, .force = force };
+    PMWalk walk = {
+        .pre = _eval_pre,
+        .post = _eval_post,
+        .flags = PMWF_next_first,
+        .arg = &ev
+    };
+    PMV_walk(&walk, vp);
+}
+
+/* @return the vertex before 'vp' on its stem, given that there is one */
+static inline PMV *_PMV_prev(PMV *vp)
+{
+    PMV *prevp = (PMV*)((char*)vp->prevnpp - offsetof(PMV, np));
+    assert(prevp->np == vp);
+    return prevp;
+}
+
+/* Re-evaluate a stem section whose rest of stem changed, following the
+ * back-links from 'untilp' to 'fromp'. The branches of the section are left
+ * as they are, and so is the symmetry of its inosculations.
+ * @param fromp first vertex of the section
+ * @param untilp last vertex of the section, on the stem of 'fromp' */
+static void _PMV_eval_stem(PMV *fromp, PMV *untilp)
+{
+    for (PMV *vp = untilp;; vp = _PMV_prev(vp)) {
+        if (_PMV_is_evaluated(vp) && _PMV_is_evaluated(vp->np))
+            _PMV_eval(vp, 1);
+        else
+            PMV_eval_r(vp, 0);
+        if (vp == fromp) break;
+    }
+}
+
+/* number of marks held by the comparison state itself, before they move to the
+ * heap. Power of 2. */
+#define PMCMP_BUFLEN 32
+
+/* the two sides of a comparison */
+enum {
+    PMCS_1,
+    PMCS_2,
+
+    PMCS_enumsize
+};
+
+/* A vertex at which a compared stem starts. */
+typedef struct {
+    const PMV *vp;
+    /* number of running comparisons starting at the vertex, by side */
+    unsigned cnt[PMCS_enumsize];
+} PMCmpMark;
+
+/* The state of a similarity comparison, see PMV_find_similar_stem(). It holds
+ * the start vertices of the stems being compared, for the overlap check. The
+ * vertices themselves are left untouched, so that comparisons can run within
+ * one another and on several threads at once. */
+typedef struct {
+    /* open addressing table of the marks, linear probing */
+    PMCmpMark *markl;
+    /* number of slots, power of 2 */
+    unsigned cap;
+    /* number of slots used */
+    unsigned len;
+    /* storage of 'markl' */
+    PMCmpMark _buf[PMCMP_BUFLEN];
+} PMCmp;
+
+static void _cmp_init(PMCmp *cmpp)
+{
+    memset(cmpp->_buf, 0, sizeof(cmpp->_buf));
+    cmpp->markl = cmpp->_buf;
+    cmpp->cap = PMCMP_BUFLEN;
+    cmpp->len = 0;
+}
+
+static void _cmp_deinit(PMCmp *cmpp)
+{
+    if (cmpp->markl != cmpp->_buf) free(cmpp->markl);
+}
+
+static inline unsigned _cmp_slot(const PMCmp *cmpp, const PMV *vp)
+{
+    uint64_t h = (uint64_t)(uintptr_t)vp * 0x9e3779b97f4a7c15ULL;
+    return (unsigned)(h >> 32) & (cmpp->cap - 1);
+}
+
+/* @return the mark of a vertex, a new one if it has none */
+static PMCmpMark *_cmp_get(PMCmp *cmpp, const PMV *vp)
+{
+    unsigned i = _cmp_slot(cmpp, vp);
+    while (cmpp->markl[i].vp) {
+        if (cmpp->markl[i].vp == vp) return &cmpp->markl[i];
+        i = (i + 1) & (cmpp->cap - 1);
+    }
+
+    if ((cmpp->len + 1) * 2 > cmpp->cap) {
+        /* keep the table at most half full */
+        PMCmpMark *oldl = cmpp->markl;
+        const unsigned oldcap = cmpp->cap;
+        cmpp->markl = calloc(oldcap * 2, sizeof(*cmpp->markl));
+        if (!cmpp->markl) {
+            printf("[Fatal][PMV][_cmp_get]: out of memory\n");
+            assert(0);
+        }
+        cmpp->cap = oldcap * 2;
+        for (unsigned j = 0; j < oldcap; j++) {
+            if (!oldl[j].vp) continue;
+            unsigned k = _cmp_slot(cmpp, oldl[j].vp);
+            while (cmpp->markl[k].vp) k = (k + 1) & (cmpp->cap - 1);
+            cmpp->markl[k] = oldl[j];
+        }
+        if (oldl != cmpp->_buf) free(oldl);
+
+        i = _cmp_slot(cmpp, vp);
+        while (cmpp->markl[i].vp) i = (i + 1) & (cmpp->cap - 1);
+    }
+
+    cmpp->len++;
+    cmpp->markl[i].vp = vp;
+    return &cmpp->markl[i];
+}
+
+/* Drop one mark of a vertex on one side, removing the vertex from the table
+ * once it has none left. */
+static void _cmp_unmark(PMCmp *cmpp, const PMV *vp, int side)
+{
+    const unsigned mask = cmpp->cap - 1;
+    unsigned i = _cmp_slot(cmpp, vp);
+    while (cmpp->markl[i].vp != vp) {
+        assert(cmpp->markl[i].vp);
+        i = (i + 1) & mask;
+    }
+
+    assert(cmpp->markl[i].cnt[side]);
+    if (--cmpp->markl[i].cnt[side] || cmpp->markl[i].cnt[!side]) return;
+
+    /* backward shift deletion: move up the marks that probed past the slot */
+    unsigned j = i;
+    for (;;) {
+        memset(&cmpp->markl[i], 0, sizeof(cmpp->markl[i]));
+        for (;;) {
+            j = (j + 1) & mask;
+            if (!cmpp->markl[j].vp) {
+                cmpp->len--;
+                return;
+            }
+            unsigned k = _cmp_slot(cmpp, cmpp->markl[j].vp);
+            /* the mark at 'j' can move to 'i' if its home slot is not
+             * cyclically in (i, j] */
+            if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) break;
+        }
+        cmpp->markl[i] = cmpp->markl[j];
+        i = j;
+    }
+}
+
+static void _find_similar_stem(
+    PMCmp *cmpp,
+    PMV *v1p,
+    PMV *v2p,
+    PMV **v1endpp,
+    PMV **v2endpp,
+    char check_summary);
+
+/* @param overlap set if the stems overlap at 'v1p' and 'v2p' */
 static void _PMV_find_common_stem(
+    PMCmp *cmpp,
     PMV *v1p,
     PMV *v2p,
     PMV **v1endpp,
     PMV **v2endpp,
-    char check_summary)
+    char check_summary,
+    char overlap)
 {
     assert(v1endpp && v2endpp);
     if (v1p) assert(v1p != v2p); /* reflexive comparison should not occur */
@@ -262,9 +750,7 @@ static void _PMV_find_common_stem(
         goto _PMV_eq_until_prev;
     }
 
-    /* check overlap */
-    if ((v1p->flags & PMV_SBIT_commonstem_start_2) ||
-        (v2p->flags & PMV_SBIT_commonstem_start_1))
+    if (overlap)
         goto _PMV_eq_until_prev;
 
     if (v1p->type != v2p->type) {
@@ -292,14 +778,15 @@ static void _PMV_find_common_stem(
         /* One is wrapper, compare its subgraphs against the other.
          * 'check_summary' overridden off, because the wrapped branch does not
          * sit on top of anything */
-        PMV_find_similar_stem(vwp->wp, vop, vwendpp, voendpp, 0);
+        _find_similar_stem(cmpp, vwp->wp, vop, vwendpp, voendpp, 0);
         /* check no similarities */
         if (!*vwendpp)              goto _PMV_eq_until_prev;   
         /* check wrapped not equal until end. */
         if ((*vwendpp)->np != NULL) goto _PMV_eq_until_prev;   
   
         /* wrapped equal until end, we can check further. */
-        PMV_find_similar_stem(vwp->np, (*voendpp)->np, vwendpp, voendpp, check_summary);
+        _find_similar_stem(
+            cmpp, vwp->np, (*voendpp)->np, vwendpp, voendpp, check_summary);
         /* check no further similarities */
         if (*vwendpp == NULL)       goto _PMV_eq_until_here;
         
@@ -324,17 +811,17 @@ static void _PMV_find_common_stem(
         if (PMV_insc_is_symm(v1p) != PMV_insc_is_symm(v2p))
             goto _PMV_eq_until_prev;
 
-        PMV_find_similar_stem(v1p->pp, v2p->pp, v1endpp, v2endpp, 1);
+        _find_similar_stem(cmpp, v1p->pp, v2p->pp, v1endpp, v2endpp, 1);
         if (*v1endpp == NULL)                   goto _PMV_eq_until_prev;
         if ((*v1endpp)->np != (*v2endpp)->np)   goto _PMV_eq_until_prev;
 
-        PMV_find_similar_stem(v1p->cp, v2p->cp, v1endpp, v2endpp, 1);
+        _find_similar_stem(cmpp, v1p->cp, v2p->cp, v1endpp, v2endpp, 1);
         if (*v1endpp == NULL)                   goto _PMV_eq_until_prev;
         if ((*v1endpp)->np != (*v2endpp)->np)   goto _PMV_eq_until_prev;
         break;
 
     case PMV_wrap:
-        PMV_find_similar_stem(v1p->wp, v2p->wp, v1endpp, v2endpp, 1);
+        _find_similar_stem(cmpp, v1p->wp, v2p->wp, v1endpp, v2endpp, 1);
         if (*v1endpp == NULL)                   goto _PMV_eq_until_prev;
         if ((*v1endpp)->np != (*v2endpp)->np)   goto _PMV_eq_until_prev; 
         break;
@@ -343,7 +830,7 @@ static void _PMV_find_common_stem(
         assert(0);
     }
 
-    PMV_find_similar_stem(v1p->np, v2p->np, v1endpp, v2endpp, check_summary);
+    _find_similar_stem(cmpp, v1p->np, v2p->np, v1endpp, v2endpp, check_summary);
     if (*v1endpp == NULL)
         goto _PMV_eq_until_here;
     
@@ -412,16 +899,51 @@ void PMV_find_similar_stem(
         return;
     }
 
-    v1p->flags |= PMV_SBIT_commonstem_start_1;
-    v2p->flags |= PMV_SBIT_commonstem_start_2;
+    PMCmp cmp;
+    _cmp_init(&cmp);
+    _find_similar_stem(&cmp, v1p, v2p, v1endpp, v2endpp, check_summary);
+    _cmp_deinit(&cmp);
+}
+
+/* PMV_find_similar_stem() within a running comparison: the start vertices are
+ * marked in the comparison state for as long as their stems are compared.
+ * @param cmpp pointer to the comparison state */
+static void _find_similar_stem(
+    PMCmp *cmpp,
+    PMV *v1p,
+    PMV *v2p,
+    PMV **v1endpp,
+    PMV **v2endpp,
+    char check_summary)
+{
+    assert(cmpp && v1endpp && v2endpp);
+    if (v1p) assert(v1p != v2p); /* reflexive comparison should not occur */
+
+    if ((!v1p != !v2p) || (v1p == v2p)) {
+        /* one terminates before the other or both null */
+        *v1endpp = NULL;
+        *v2endpp = NULL;
+        return;
+    }
+
+    PMCmpMark *m1p = _cmp_get(cmpp, v1p);
+    m1p->cnt[PMCS_1]++;
+    const char overlap1 = m1p->cnt[PMCS_2] != 0;
+    PMCmpMark *m2p = _cmp_get(cmpp, v2p);
+    m2p->cnt[PMCS_2]++;
+    const char overlap = overlap1 || m2p->cnt[PMCS_1] != 0;
 
-    _PMV_find_common_stem(v1p, v2p, v1endpp, v2endpp, check_summary);
+    _PMV_find_common_stem(
+        cmpp, v1p, v2p, v1endpp, v2endpp, check_summary, overlap);
 
-    v1p->flags &= !PMV_SBIT_commonstem_start_1;
-    v2p->flags &= !PMV_SBIT_commonstem_start_2;
+    _cmp_unmark(cmpp, v2p, PMCS_2);
+    _cmp_unmark(cmpp, v1p, PMCS_1);
 }
 
-/* Check if the PPMs starting at 'v1' and 'v2' are similar.
+/* Check if the PPMs starting at 'v1' and 'v2' are similar. Evaluated trees
+ * are told apart by their classes. Trees of the same class are similar, unless
+ * wrappers on both sides wrap different sections, so the trees are only
+ * compared once the context holds wrappers.
  * @param v1 pointer to a vertex
  * @param v2 pointer to another vertex
  * @param check_summary see PMV_find_common_stem()
@@ -429,6 +951,12 @@ void PMV_find_similar_stem(
 int PMV_is_similar(PMV *v1, PMV *v2, char check_summary)
 {
     if (!v1) return v1 == v2;
+    if (!v2) return 0;
+
+    if (_PMV_is_evaluated(v1) && _PMV_is_evaluated(v2)) {
+        if (v1->cls != v2->cls) return 0;
+        if (!v1->ctxp->pmvcnt[PMV_wrap]) return 1;
+    }
     
     PMV *v1end, *v2end;
     PMV_find_similar_stem(v1, v2, &v1end, &v2end, check_summary);
@@ -437,29 +965,88 @@ int PMV_is_similar(PMV *v1, PMV *v2, char check_summary)
     return 1;
 }
 
-/* Merge two PMV groups. All the members of 'from' are transferred to 'to' and
- * their membership is updated, then 'from' is destroyed.
+/* Find the group a group was merged into, compressing the path on the way.
+ * @param gp pointer to a group
+ * @return the group not merged into another one */
+static PMVG *PMVG_find(PMVG *gp)
+{
+    assert(gp);
+    PMVG *rootp = gp;
+    while (rootp->ufp) rootp = rootp->ufp;
+
+    while (gp != rootp) {
+        PMVG *nextp = gp->ufp;
+        gp->ufp = rootp;
+        gp = nextp;
+    }
+    return rootp;
+}
+
+/* @return the group of a vertex
+ * @param vp pointer to a vertex */
+PMVG *PMV_getgroup(PMV *vp)
+{
+    assert(vp);
+    return PMVG_find(vp->gp);
+}
+
+/* Merge two PMV groups, union-find style: the smaller group is merged into the
+ * bigger one and leaves the group list, its members stay where they are until
+ * PMContext_flush_groups().
  * @param to merge destination
  * @param from merge source
  * @return 0 on success, -1 otherwise */
-static int PMVG_merge(PMVG *to, PMVG *from)
+int PMVG_merge(PMVG *to, PMVG *from)
 {
     assert(to && from);
+    to = PMVG_find(to);
+    from = PMVG_find(from);
     if (to == from) return 0;
     assert(to->cpmv.type == from->cpmv.type);
-    PMV **vpp;
-    while ((vpp = arll_next(from->vpl))) {
-        PMV *vp = *vpp;
-        vp->gp = to;
-        assert (PMVG_addv(to, vp) == 0);
+
+    if (to->size < from->size) {
+        PMVG *tmp = to;
+        to = from;
+        from = tmp;
     }
+    from->ufp = to;
+    to->size += from->size;
 
-    Object_deinit((Object*)from);
-    _obj_free(from);
+    PMContext *pmctx = _PMVG_pmctx(from);
+    PMContext_thaw_groups(pmctx);
+    _Elem_deinit((Object*)from);
+    if (arll_push(pmctx->gmergedl, &from) == -1) return -1;
 
     return 0;
 }
 
+/* Move the members of the merged groups to the groups they were merged into
+ * and release the merged groups. Afterwards, 'gp' of each vertex points to its
+ * group and the member lists are complete.
+ * @param ctx pointer to a PM context */
+static void PMContext_flush_groups(PMContext *ctx)
+{
+    assert(ctx);
+    /* a group only points to groups merged after itself, so the list can be
+     * released in order */
+    PMVG **gpp;
+    arll_rewind(ctx->gmergedl);
+    while ((gpp = arll_next(ctx->gmergedl))) {
+        PMVG *gp = *gpp;
+        PMVG *rootp = PMVG_find(gp);
+
+        PMV **vpp;
+        arll_rewind(gp->vpl);
+        while ((vpp = arll_next(gp->vpl))) {
+            (*vpp)->gp = rootp;
+            assert(arll_push(rootp->vpl, vpp) != -1);
+        }
+        arll_deinit(gp->vpl);
+        slab_free(ctx->pmvg_slab, gp);
+    }
+    while (!arll_pop(ctx->gmergedl, NULL));
+}
+
 /* Merge two similar subtrees starting at 'v1p' and 'v2p'. The merging process
  * merges the groups of corresponding vertices.
  * @param v1p a non-NULL vertex pointer
@@ -519,7 +1106,7 @@ void PMV_merge_r(PMV *v1p, PMV *v2p) {
     }
 
     PMV_merge_r(v1p->np, v2p->np);
-    PMVG_merge(v1p->gp, v2p->gp);
+    assert(PMVG_merge(v1p->gp, v2p->gp) == 0);
 }
 
 static PMV *PMV_create(PMContext *ctx, PMVType type, PMV **prevnpp)
@@ -527,13 +1114,13 @@ static PMV *PMV_create(PMContext *ctx, PMVType type, PMV **prevnpp)
     assert((unsigned)type < PMV_enumsize);
     assert(ctx);
 
-    PMV *nvp = malloc(sizeof(*nvp));
+    PMContext_thaw(ctx);
+    PMV *nvp = slab_alloc(ctx->pmv_slab);
     assert(nvp);
-    *nvp = pmv_zero;
 
     nvp->type = type;
     nvp->prevnpp = prevnpp;
-    nvp->gp = _obj_alloc(sizeof(PMVG));
+    nvp->gp = slab_alloc(ctx->pmvg_slab);
     assert(!PMVG_init(ctx, nvp->gp, type));
     nvp->ctxp = ctx;
     assert(nvp->gp);
@@ -579,7 +1166,7 @@ static void plot_node(const PMV *vp, double x, double y, gnuplot *gplp)
         x,
         y,
         _lab[vp->type],
-        vp->gp->id,
+        PMVG_find(vp->gp)->id,
         BIG_C_RAD);
 }
 
@@ -765,13 +1352,16 @@ PMV *PMV_wrap_section(PMV *fromp, PMV *untilp)
     } else {
         printf(
             "[Warning][PMV][PMV_wrap_section]: superfluous wrapper around vertex in group %u\n",
-            nv->wp->gp->id);
+            PMV_getgroup(nv->wp)->id);
     }
 
     if (nv->np)
         nv->np->prevnpp = &nv->np;
 
-    PMV_eval_r(nv->wp, 1);
+    /* Only the section lost the rest of its stem. The summary of a tree does
+     * not see wrappers, so the wrapper takes over the summary of 'fromp' and
+     * the vertices above stay as they are. */
+    _PMV_eval_stem(fromp, untilp);
     PMV_eval_r(nv, 0);
 
     return nv;
@@ -807,13 +1397,17 @@ void PMV_plot(PMContext *ctx)
     fflush(gplot_getp(ctx->gplot, PP_graph));
 }
 
+/* Create a segment vertex from the consecutive calculation and communication
+ * tasks starting at the current task '*ctip'. On return, the current task is
+ * the one following the segment. */
 static PMV* _create_seg(
     MParser *parsctx,
+    TaskNo *ctip,
     PMContext *pmctx,
     PMV **prevnpp,
     TaskSegRawCtx *tsrctx)
 {
-    MPTask ct = parsctx->task_l[parsctx->cti];
+    MPTask ct = MParser_get_task(parsctx, *ctip);
     PMV *nv = PMV_create(pmctx, PMV_seg, prevnpp);
     assert(nv);
 
@@ -838,7 +1432,7 @@ static PMV* _create_seg(
             printf(
                 "[Fatal][PMV][create_seg]: task %lu has pid=%d"
                 "but the segment has pid=%d\n",
-                parsctx->cti,
+                MParser_tno(parsctx, *ctip),
                 ct.pno,
                 nsegcont.pid);
             assert(0);
@@ -846,12 +1440,12 @@ static PMV* _create_seg(
         if(TSR_put((TaskSegRaw*)nsegcont.segp, csegt) != TSR_ok) {
             printf(
                 "[Fatal][PMV][create_seg]: on task %lu, TSeg_put failed.\n",
-                parsctx->cti);
+                MParser_tno(parsctx, *ctip));
             assert(0);
         }
 
-        parsctx->cti = ct.next[0];
-        ct = parsctx->task_l[parsctx->cti];
+        *ctip = ct.next[0];
+        ct = MParser_get_task(parsctx, *ctip);
     }
 
 //    nsegcont.segp = nsegp;
@@ -860,204 +1454,1462 @@ static PMV* _create_seg(
     nv->segconti = arll_push(pmctx->segcontl, &nsegcont);
     assert(nv->segconti != -1);
 
-    nv->np = _build_graph(parsctx, pmctx, &nv->np, tsrctx);
-    assert(parsctx->cti);
     return nv;
 }
 
-static PMV* _create_insc(
-    MParser *parsctx,
-    PMContext *pmctx,
-    PMV **prevnpp,
-    TaskSegRawCtx *tsrctx)
-{
-    MPTask ct = parsctx->task_l[parsctx->cti];
-
-    PMV *nv;
-    if (ct.next[1] == 0) {
-        int pno = ct.pno;
-        /* empty fork, ignore */
-        parsctx->cti = ct.next[0];
-        ct = parsctx->task_l[parsctx->cti];
-        assert(ct.ttype == MPTT_forkend);
-        assert(ct.pno == pno);
-        parsctx->cti = ct.next[0];
-        nv =  _build_graph(parsctx, pmctx, prevnpp, tsrctx);
-        parsctx->cti = parsctx->task_l[parsctx->cti].next[0];
-        nv->np = _build_graph(parsctx, pmctx, &nv->np, tsrctx);
-        assert(parsctx->cti);
-        return nv;
-    }
-
-    TaskNo ret_ti, fork_ti;
-    fork_ti = parsctx->cti;
-
-    nv = PMV_create(pmctx, PMV_insc, prevnpp);
-    assert(nv);
-
-    parsctx->cti = ct.next[0];
-    nv->pp = _build_graph(parsctx, pmctx, &nv->pp, tsrctx);
-    assert(parsctx->cti);
-    if (!nv->pp) {
-        printf(
-            "[Fatal][PMV][create_insc]: on fork %lu, parent branch empty.\n",
-            fork_ti);
-        assert(0);
-    }
-    ret_ti = parsctx->cti;
+/* Hash-consing build, see PMF_hashcons.
+ * A vertex is looked up once its subtree is complete, i.e. after its branches
+ * and the rest of its stem. Two complete subtrees are identical if their roots
+ * are alike and their branches and next vertices are in the same groups, as
+ * the identical subtrees looked up before already share their groups. So a
+ * subtree identical to a known one only needs its root to join the group of
+ * the other root. */
+struct PMHashCons {
+    PMContext *ctx;
+    /* group of the first subtree of each hash */
+    ulmap *classm;
+    /* vertices of the stem being looked up */
+    arll *stem;
+};
 
-    parsctx->cti = ct.next[1];
-    nv->cp = _build_graph(parsctx, pmctx, &nv->cp, tsrctx);
-    assert(parsctx->cti);
-    if (!nv->cp) {
-        printf(
-            "[Fatal][PMV][create_insc]: on fork %lu, child branch empty.\n",
-            fork_ti);
-        assert(0);
-    }
+static void _hc_deinit(PMHashCons *hcp)
+{
+    ulmap_destroy(hcp->classm);
+    if (hcp->stem) arll_destroy(hcp->stem);
+}
 
-    if (ret_ti != parsctx->cti) {
-        printf(
-            "[Fatal][PMV][create_insc]: on fork %lu(lno=%lu), branches don't meet:"
-            "parent join=%lu(lno=%lu), child join=%lu(lno=%lu)\n",
-            fork_ti, parsctx->task_l[fork_ti].lno,
-            ret_ti, parsctx->task_l[ret_ti].lno,
-            parsctx->cti, parsctx->task_l[parsctx->cti].lno);
-        assert(0);
-    }
-    parsctx->cti = parsctx->task_l[ret_ti].next[0];
+static int _hc_init(PMHashCons *hcp, PMContext *ctx)
+{
+    hcp->ctx = ctx;
+    hcp->classm = ulmap_construct(sizeof(PMVG*), 1024);
+    hcp->stem = arll_construct(sizeof(PMV*), 64);
+    if (hcp->classm && hcp->stem) return 0;
 
-    nv->np = _build_graph(parsctx, pmctx, &nv->np, tsrctx);
-    assert(parsctx->cti);
+    _hc_deinit(hcp);
+    return -1;
+}
 
-    return nv;
+static inline uint64_t _hc_mix(uint64_t h, uint64_t v)
+{
+    /* the class ids are small consecutive numbers, spread them well */
+    h ^= v * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return h;
 }
 
+/* @return id of the group of a vertex plus one, 0 for NULL */
+static inline uint64_t _hc_class(PMV *vp)
+{
+    return vp ? (uint64_t)PMV_getgroup(vp)->id + 1 : 0;
+}
 
-static PMV* _build_graph(
-    MParser *parsctx,
-    PMContext *pmctx,
-    PMV **prevnpp,
-    TaskSegRawCtx *tsrctx)
+/* @return 1 if both vertices are NULL or in the same group, 0 otherwise */
+static inline char _hc_same(PMV *v1p, PMV *v2p)
 {
-    MPTask ct = parsctx->task_l[parsctx->cti];
-    PMV *nv = NULL;
+    if (!v1p || !v2p) return v1p == v2p;
+    return PMV_getgroup(v1p) == PMV_getgroup(v2p);
+}
 
-    switch(ct.ttype) {
-    case MPTT_fork:
-        nv = _create_insc(parsctx, pmctx, prevnpp, tsrctx);
-        assert(parsctx->cti);
+/* Look up the complete subtree of a vertex, and join the group of the first
+ * identical one.
+ * @return 0 on success, -1 on memory allocation issues */
+static int _hc_vertex(PMHashCons *hcp, PMV *vp)
+{
+    uint64_t h = _hc_mix(vp->type, _hc_class(vp->np));
+    switch (vp->type) {
+    case PMV_seg:
+        h = _hc_mix(h, TSR_hash((TaskSegRaw*)PMV_getseg(vp).segp));
         break;
-    case MPTT_calc:
-    case MPTT_com:
-        nv = _create_seg(parsctx, pmctx, prevnpp, tsrctx);
-        assert(parsctx->cti);
+    case PMV_insc:
+        h = _hc_mix(h, _hc_class(vp->pp));
+        h = _hc_mix(h, _hc_class(vp->cp));
         break;
-
-    case MPTT_forkend:
-        parsctx->cti = parsctx->task_l[parsctx->cti].next[0];
-        return _build_graph(parsctx, pmctx, prevnpp, tsrctx);
-
-    case MPTT_join:
-    case MPTT_end:
+    case PMV_wrap:
+        h = _hc_mix(h, _hc_class(vp->wp));
         break;
-    case MPTT_start:
-        printf(
-            "[Fatal][PMV][_build_graph]: task %lu, is of type 'start'.\n",
-            parsctx->cti);
+    default:
         assert(0);
+    }
+    /* not a valid key */
+    if (h == (unsigned long)-1) h--;
+
+    PMVG **gpp = ulmap_get(hcp->classm, h);
+    if (!gpp) {
+        gpp = ulmap_put(hcp->classm, h);
+        if (!gpp) return -1;
+        *gpp = vp->gp;
+        return 0;
+    }
+
+    /* the first group stays the root of its class, as the groups joining it
+     * are singletons, so its first member is the first subtree */
+    PMV *repp = *(PMV**)arll_geti(PMVG_find(*gpp)->vpl, 0);
+    /* on hash collisions, the subtree stays apart */
+    if (repp->type != vp->type || !_hc_same(repp->np, vp->np)) return 0;
+    switch (vp->type) {
+    case PMV_seg:
+        if (!TSR_equal(
+                (TaskSegRaw*)PMV_getseg(repp).segp,
+                (TaskSegRaw*)PMV_getseg(vp).segp))
+            return 0;
+        break;
+    case PMV_insc:
+        if (!_hc_same(repp->pp, vp->pp) || !_hc_same(repp->cp, vp->cp))
+            return 0;
         break;
     default:
-        /* Should never occur */
-        assert(0);
+        if (!_hc_same(repp->wp, vp->wp)) return 0;
     }
 
-   return nv;
+    return PMVG_merge(*gpp, vp->gp);
 }
 
-/* Build a PPM graph from a parser context.
- * @param parsctx pointer to a parser context that contains the parsed model
- * @param pm_ctx PM context where the graph will be created
- * @param tsrctx TaskSegRaw context pointer for storing the segments */
-int PMV_build_graph(MParser *parsctx, PMContext *pm_ctx, TaskSegRawCtx *tsrctx)
+/* Look up the vertices of a complete stem, last one first.
+ * @return 0 on success, -1 on memory allocation issues */
+static int _hc_stem(PMHashCons *hcp, PMV *vp)
 {
-    assert(parsctx && pm_ctx);
-    MPTask ct = parsctx->task_l[parsctx->head];
-
-    if (ct.ttype != MPTT_start) return MP_err;
-    if (!ct.next[0]) return MP_err;
-    parsctx->cti = ct.next[0];
-    pm_ctx->headp = _build_graph(parsctx, pm_ctx, &pm_ctx->headp, tsrctx);
-    assert(pm_ctx->headp);
-    PMV_eval_r(pm_ctx->headp, 1);
-
+    for (; vp; vp = vp->np)
+        if (arll_push(hcp->stem, &vp) == -1) return -1;
+    while (!arll_pop(hcp->stem, &vp))
+        if (_hc_vertex(hcp, vp)) return -1;
+
+    /* the joined groups are recycled for the vertices yet to be built */
+    if (arll_len(hcp->ctx->gmergedl) >= PMV_SLAB_CHUNK)
+        PMContext_flush_groups(hcp->ctx);
     return 0;
 }
 
-static void _PMV_destroy_r(PMV *pmv)
+static PMWRes _hc_post(PMWalk *walkp, PMV *vp)
 {
-    if (!pmv) return;
-
-    switch (pmv->type) {
-    case PMV_seg:
-        break;
-    case PMV_insc:
-        _PMV_destroy_r(pmv->pp);
-        _PMV_destroy_r(pmv->cp);
-        break;
-    case PMV_wrap:
-        _PMV_destroy_r(pmv->wp);
-        break;
-    default:
-        assert(0);
-    }
-    _PMV_destroy_r(pmv->np);
-    free(pmv);
+    return _hc_vertex(walkp->arg, vp) ? PMW_stop : PMW_cont;
 }
 
-/* Deinit and deallocate a context previously allocated by PMContext_create()
- * @param ctx pointer to a context*/
-void PMContext_destroy(PMContext *ctx)
+/* Hash-cons a tree once built, for the builders that cannot do it on the way.
+ * @return MP_ok on success, MP_mem on memory allocation issues */
+static int _hashcons(PMContext *ctx)
 {
-    if (!ctx) return;
+    PMHashCons hc;
+    if (_hc_init(&hc, ctx)) return MP_mem;
 
-    Object_deinit((Object*)&ctx->gctx);
-    _PMV_destroy_r(ctx->headp);
-    arll_destroy(ctx->segcontl);
-    gplot_destroy(ctx->gplot);
-    free(ctx);
+    PMWalk walk = { .post = _hc_post, .flags = PMWF_next_first, .arg = &hc };
+    int res = PMV_walk(&walk, ctx->headp) == PMW_stop ? MP_mem : MP_ok;
+    PMContext_flush_groups(ctx);
+
+    _hc_deinit(&hc);
+    return res;
 }
 
-static const PM_seg_summary pmsegsummary_zero = { 0 };
+/* What remains to be done once the branch being built reaches its join */
+typedef enum {
+    /* parent branch of an inosculation done, build the child branch */
+    PMB_insc_cp,
+    /* child branch done, continue after the join */
+    PMB_insc_join,
+    /* branch of an empty fork done, continue after the join */
+    PMB_empty_join
+} PMBuildStep;
 
-static TaskSeg_summary *_get_seg_summary(PMContext *ctx)
-{
-    assert(ctx);
-    unsigned vcntl[PMV_enumsize];
-    PMContext_get_vcnt(ctx, vcntl);
-    unsigned segcnt = vcntl[PMV_seg];
+typedef struct {
+    PMBuildStep step;
+    /* inosculation vertex */
+    PMV *nv;
+    TaskNo fork_ti;
+    /* join of the parent branch */
+    TaskNo ret_ti;
+    /* parallel build: task building the child branch, if spawned */
+    PMBTask *taskp;
+} PMBuildFrame;
+
+/* Parallel build.
+ * The child branches of the forks found large enough by _mt_plan() are built
+ * by tasks, run by a pool of threads. Each task builds into a PM context and
+ * a segment context of its own, so that the threads share nothing but the
+ * task queue. Once all the tasks are done, their vertices, groups and
+ * segments are moved into the target contexts in the order PMV_build_graph()
+ * would create them, see _mt_adopt(). */
+typedef struct PMBPool PMBPool;
+
+/* A task spawned at position 'gcnt' of the groups of its spawner */
+typedef struct {
+    unsigned gcnt;
+    PMBTask *taskp;
+} PMBInsert;
+
+struct PMBTask {
+    PMBPool *poolp;
+    /* fork of the child branch, and first task of the branch */
+    TaskNo fork_ti;
+    TaskNo from_ti;
+    /* join of the parent branch, set by the spawner */
+    TaskNo ret_ti;
+    /* task the branch ended at */
+    TaskNo end_ti;
+    /* where the branch is stored */
+    PMV **prevnpp;
+    PMContext *ctx;
+    TaskSegRawCtx tsrctx;
+    /* spawned tasks (PMBInsert), in build order */
+    arll *insl;
+    int res;
+};
 
-    TaskSeg_summary *tss = malloc(sizeof(*tss) * segcnt);
-    assert(tss);
+struct PMBPool {
+    MParser *parsctx;
+    /* target segment context */
+    TaskSegRawCtx *tsrctx;
+    /* forks whose child branch is built by a task */
+    ulmap *spawnm;
+    /* all the tasks, the first one being the root */
+    arll *taskl;
+    /* tasks not started yet */
+    arll *queue;
+    /* tasks queued or running */
+    unsigned busy;
+    int res;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+};
 
-    unsigned ci = 0;
-    PMVG *currgp = (PMVG*)ctx->gctx._super.elem_dll;
-    while (currgp) {
-        if (currgp->cpmv.type == PMV_seg) {
-            PMV **vpp;
-            arll_rewind(currgp->vpl);
-            while ((vpp = arll_next(currgp->vpl))) {
-                assert(ci < segcnt);
-                tss[ci++] = TaskSeg_eval(PMV_getseg(*vpp).segp);
+static PMBTask *_mt_spawn(
+    PMBPool *poolp,
+    TaskNo fork_ti,
+    TaskNo from_ti,
+    PMV **prevnpp);
+
+/* Build the PPM graph starting at the current task '*ctip' into '*prevnpp'.
+ * The branches are built depth-first, parent branch first, and the stems are
+ * followed in a loop, so that the vertices are created in the same order as
+ * a recursive descent would. Only the forks being built are kept, on a heap
+ * stack. On return, '*ctip' is the join or the end the graph ended at.
+ * @param hcp hash-consing build: lookup state, NULL otherwise. The stems are
+ *  looked up as they end.
+ * @param taskp parallel build: the task running the build, NULL otherwise
+ * @return MP_ok on success, MP_mem on memory allocation issues */
+static int _build_graph(
+    MParser *parsctx,
+    TaskNo *ctip,
+    PMContext *pmctx,
+    PMV **prevnpp,
+    TaskSegRawCtx *tsrctx,
+    PMHashCons *hcp,
+    PMBTask *taskp)
+{
+    arll *stack = arll_construct(sizeof(PMBuildFrame), 64);
+    if (!stack) return MP_mem;
+    PMBuildFrame fr;
+    TaskNo cti = *ctip;
+    /* where the next vertex is stored */
+    PMV **vpp = prevnpp;
+    PMV *nv;
+
+    while (1) {
+        MPTask ct = MParser_get_task(parsctx, cti);
+
+        switch(ct.ttype) {
+        case MPTT_calc:
+        case MPTT_com:
+            nv = _create_seg(parsctx, &cti, pmctx, vpp, tsrctx);
+            assert(cti);
+            *vpp = nv;
+            vpp = &nv->np;
+            continue;
+
+        case MPTT_fork:
+            if (ct.next[1] == 0) {
+                int pno = ct.pno;
+                /* empty fork, ignore */
+                cti = ct.next[0];
+                ct = MParser_get_task(parsctx, cti);
+                assert(ct.ttype == MPTT_forkend);
+                assert(ct.pno == pno);
+                cti = ct.next[0];
+                fr = (PMBuildFrame){ .step = PMB_empty_join };
+                if (arll_push(stack, &fr) == -1) goto nomem;
+                continue;
+            }
+
+            nv = PMV_create(pmctx, PMV_insc, vpp);
+            assert(nv);
+            *vpp = nv;
+            fr = (PMBuildFrame){
+                .step = PMB_insc_cp,
+                .nv = nv,
+                .fork_ti = cti
+            };
+            if (taskp && ulmap_get(taskp->poolp->spawnm, cti)) {
+                fr.taskp = _mt_spawn(taskp->poolp, cti, ct.next[1], &nv->cp);
+                if (!fr.taskp) goto nomem;
             }
+            if (arll_push(stack, &fr) == -1) goto nomem;
+            cti = ct.next[0];
+            vpp = &nv->pp;
+            continue;
+
+        case MPTT_forkend:
+            cti = ct.next[0];
+            continue;
+
+        case MPTT_join:
+        case MPTT_end:
+            break;
+        case MPTT_start:
+            printf(
+                "[Fatal][PMV][_build_graph]: task %lu, is of type 'start'.\n",
+                MParser_tno(parsctx, cti));
+            assert(0);
+            break;
+        default:
+            /* Should never occur */
+            assert(0);
+        }
+
+        /* end of a branch */
+        *vpp = NULL;
+        if (arll_pop(stack, &fr)) {
+            if (hcp && _hc_stem(hcp, *prevnpp)) goto nomem;
+            break;
+        }
+        assert(cti);
+
+        switch (fr.step) {
+        case PMB_insc_cp:
+            if (!fr.nv->pp) {
+                printf(
+                    "[Fatal][PMV][create_insc]: on fork %lu, parent branch "
+                    "empty.\n",
+                    MParser_tno(parsctx, fr.fork_ti));
+                assert(0);
+            }
+            if (hcp && _hc_stem(hcp, fr.nv->pp)) goto nomem;
+            if (fr.taskp) {
+                /* the child branch is built by the task, its vertices
+                 * follow the ones of the parent branch */
+                PMBInsert ins = { pmctx->gctx.gid_curr, fr.taskp };
+                fr.taskp->ret_ti = cti;
+                if (arll_push(taskp->insl, &ins) == -1) goto nomem;
+                cti = MParser_get_task(parsctx, cti).next[0];
+                vpp = &fr.nv->np;
+                break;
+            }
+            fr.ret_ti = cti;
+            fr.step = PMB_insc_join;
+            if (arll_push(stack, &fr) == -1) goto nomem;
+            cti = MParser_get_task(parsctx, fr.fork_ti).next[1];
+            vpp = &fr.nv->cp;
+            break;
+
+        case PMB_insc_join:
+            if (!fr.nv->cp) {
+                printf(
+                    "[Fatal][PMV][create_insc]: on fork %lu, child branch "
+                    "empty.\n",
+                    MParser_tno(parsctx, fr.fork_ti));
+                assert(0);
+            }
+            if (fr.ret_ti != cti) {
+                printf(
+                    "[Fatal][PMV][create_insc]: on fork %lu(lno=%lu), branches don't meet:"
+                    "parent join=%lu(lno=%lu), child join=%lu(lno=%lu)\n",
+                    MParser_tno(parsctx, fr.fork_ti),
+                    MParser_get_task(parsctx, fr.fork_ti).lno,
+                    MParser_tno(parsctx, fr.ret_ti),
+                    MParser_get_task(parsctx, fr.ret_ti).lno,
+                    MParser_tno(parsctx, cti),
+                    MParser_get_task(parsctx, cti).lno);
+                assert(0);
+            }
+            if (hcp && _hc_stem(hcp, fr.nv->cp)) goto nomem;
+            cti = MParser_get_task(parsctx, fr.ret_ti).next[0];
+            vpp = &fr.nv->np;
+            break;
+
+        case PMB_empty_join:
+            /* the branch and the vertices following the join are one
+             * sequence */
+            cti = MParser_get_task(parsctx, cti).next[0];
+            break;
+        }
+    }
+
+    arll_destroy(stack);
+    *ctip = cti;
+    return MP_ok;
+
+nomem:
+    arll_destroy(stack);
+    *ctip = cti;
+    return MP_mem;
+}
+
+/* Build a PPM graph from a parser context. With PMF_hashcons set in the
+ * context, the identical subtrees are joined while the graph is built.
+ * @param parsctx pointer to a parser context that contains the parsed model
+ * @param pm_ctx PM context where the graph will be created
+ * @param tsrctx TaskSegRaw context pointer for storing the segments */
+int PMV_build_graph(MParser *parsctx, PMContext *pm_ctx, TaskSegRawCtx *tsrctx)
+{
+    assert(parsctx && pm_ctx);
+    MPTask ct = MParser_get_task(parsctx, parsctx->head);
+
+    if (ct.ttype != MPTT_start) return MP_err;
+    if (!ct.next[0]) return MP_err;
+    parsctx->cti = ct.next[0];
+    PMHashCons hc, *hcp = NULL;
+    if (pm_ctx->flags & PMF_hashcons) {
+        if (_hc_init(&hc, pm_ctx)) return MP_mem;
+        hcp = &hc;
+    }
+    int res = _build_graph(
+        parsctx,
+        &parsctx->cti,
+        pm_ctx,
+        &pm_ctx->headp,
+        tsrctx,
+        hcp,
+        NULL);
+    if (hcp) {
+        PMContext_flush_groups(pm_ctx);
+        _hc_deinit(hcp);
+    }
+    if (res != MP_ok) return MP_mem;
+    assert(pm_ctx->headp);
+    PMV_eval_r(pm_ctx->headp, 1);
+
+    return 0;
+}
+
+typedef struct {
+    PMBuildStep step;
+    TaskNo fork_ti;
+    /* join of the parent branch */
+    TaskNo ret_ti;
+    /* number of tasks counted when the child branch started */
+    unsigned long cnt;
+} PMBPlanFrame;
+
+/* Walk the model from 'cti' the way _build_graph() does, and store in
+ * 'spawnm' the forks whose child branch counts at least 'min_tasks' tasks.
+ * Malformed models are left to _build_graph() to report.
+ * @return MP_ok on success, MP_mem on memory allocation issues */
+static int _mt_plan(
+    MParser *parsctx,
+    TaskNo cti,
+    unsigned long min_tasks,
+    ulmap *spawnm)
+{
+    arll *stack = arll_construct(sizeof(PMBPlanFrame), 64);
+    if (!stack) return MP_mem;
+    PMBPlanFrame fr;
+    unsigned long cnt = 0;
+
+    while (1) {
+        MPTask ct = MParser_get_task(parsctx, cti);
+        cnt++;
+
+        switch (ct.ttype) {
+        case MPTT_calc:
+        case MPTT_com:
+        case MPTT_forkend:
+            cti = ct.next[0];
+            continue;
+
+        case MPTT_fork:
+            fr = (PMBPlanFrame){
+                .step = ct.next[1] ? PMB_insc_cp : PMB_empty_join,
+                .fork_ti = cti
+            };
+            if (arll_push(stack, &fr) == -1) goto nomem;
+            cti = ct.next[0];
+            continue;
+
+        default:
+            break;
+        }
+
+        /* end of a branch */
+        if (arll_pop(stack, &fr)) break;
+
+        switch (fr.step) {
+        case PMB_insc_cp:
+            fr.ret_ti = cti;
+            fr.cnt = cnt;
+            fr.step = PMB_insc_join;
+            if (arll_push(stack, &fr) == -1) goto nomem;
+            cti = MParser_get_task(parsctx, fr.fork_ti).next[1];
+            break;
+
+        case PMB_insc_join:
+            if (cnt - fr.cnt >= min_tasks && !ulmap_put(spawnm, fr.fork_ti))
+                goto nomem;
+            cti = MParser_get_task(parsctx, fr.ret_ti).next[0];
+            break;
+
+        case PMB_empty_join:
+            cti = MParser_get_task(parsctx, cti).next[0];
+            break;
+        }
+    }
+
+    arll_destroy(stack);
+    return MP_ok;
+
+nomem:
+    arll_destroy(stack);
+    return MP_mem;
+}
+
+/* Create a task building the branch starting at 'from_ti' into '*prevnpp',
+ * and queue it. Called by the root task before the threads start, and by the
+ * running tasks.
+ * @return pointer to the task, NULL on memory allocation issues */
+static PMBTask *_mt_spawn(
+    PMBPool *poolp,
+    TaskNo fork_ti,
+    TaskNo from_ti,
+    PMV **prevnpp)
+{
+    PMBTask *tp = malloc(sizeof(*tp));
+    if (!tp) return NULL;
+    *tp = (PMBTask){
+        .poolp = poolp,
+        .fork_ti = fork_ti,
+        .from_ti = from_ti,
+        .prevnpp = prevnpp,
+        .res = MP_ok
+    };
+    tp->insl = arll_construct(sizeof(PMBInsert), 8);
+    if (!tp->insl) {
+        free(tp);
+        return NULL;
+    }
+    tp->ctx = PMContext_create();
+    /* the segments are evaluated with the options of the target context */
+    assert(!TaskSegRawCtx_init(
+        &tp->tsrctx,
+        poolp->tsrctx->compopt.mu_max,
+        poolp->tsrctx->compopt.sigma_max));
+
+    pthread_mutex_lock(&poolp->mtx);
+    if (arll_push(poolp->taskl, &tp) == -1) {
+        pthread_mutex_unlock(&poolp->mtx);
+        PMContext_destroy(tp->ctx);
+        arll_destroy(tp->insl);
+        free(tp);
+        return NULL;
+    }
+    /* from here on, the task is released with the pool */
+    if (arll_push(poolp->queue, &tp) == -1) {
+        pthread_mutex_unlock(&poolp->mtx);
+        return NULL;
+    }
+    poolp->busy++;
+    pthread_cond_signal(&poolp->cond);
+    pthread_mutex_unlock(&poolp->mtx);
+
+    return tp;
+}
+
+/* Run the queued tasks until all of them are done */
+static void *_mt_worker(void *arg)
+{
+    PMBPool *poolp = arg;
+    PMBTask *tp;
+
+    pthread_mutex_lock(&poolp->mtx);
+    while (poolp->busy) {
+        if (arll_pop(poolp->queue, &tp)) {
+            pthread_cond_wait(&poolp->cond, &poolp->mtx);
+            continue;
+        }
+        pthread_mutex_unlock(&poolp->mtx);
+
+        TaskNo cti = tp->from_ti;
+        tp->res = _build_graph(
+            poolp->parsctx,
+            &cti,
+            tp->ctx,
+            tp->prevnpp,
+            &tp->tsrctx,
+            NULL,
+            tp);
+        tp->end_ti = cti;
+
+        pthread_mutex_lock(&poolp->mtx);
+        if (!--poolp->busy) pthread_cond_broadcast(&poolp->cond);
+    }
+    pthread_mutex_unlock(&poolp->mtx);
+
+    return NULL;
+}
+
+/* Check the branch built by a spawned task, as _build_graph() does for the
+ * child branches it builds itself */
+static void _mt_check(MParser *parsctx, PMBTask *tp)
+{
+    if (!*tp->prevnpp) {
+        printf(
+            "[Fatal][PMV][create_insc]: on fork %lu, child branch "
+            "empty.\n",
+            MParser_tno(parsctx, tp->fork_ti));
+        assert(0);
+    }
+    if (tp->ret_ti != tp->end_ti) {
+        printf(
+            "[Fatal][PMV][create_insc]: on fork %lu(lno=%lu), branches don't meet:"
+            "parent join=%lu(lno=%lu), child join=%lu(lno=%lu)\n",
+            MParser_tno(parsctx, tp->fork_ti),
+            MParser_get_task(parsctx, tp->fork_ti).lno,
+            MParser_tno(parsctx, tp->ret_ti),
+            MParser_get_task(parsctx, tp->ret_ti).lno,
+            MParser_tno(parsctx, tp->end_ti),
+            MParser_get_task(parsctx, tp->end_ti).lno);
+        assert(0);
+    }
+}
+
+/* Move a group created by a task, its vertex and its segment into the target
+ * contexts, registering them as the vertex creation would. */
+static void _mt_adopt_group(
+    PMContext *ctx,
+    TaskSegRawCtx *tsrctx,
+    PMBTask *tp,
+    PMVG *gp)
+{
+    Elem_move_ctx((Elem*)gp, (ElemCtx*)&ctx->gctx);
+    gp->id = ctx->gctx.gid_curr++;
+
+    /* no merges yet, the vertex is the only member */
+    PMV *vp = *(PMV**)arll_geti(gp->vpl, 0);
+    vp->ctxp = ctx;
+    if (vp->type != PMV_seg) return;
+
+    Segcont *segcontp = arll_geti(tp->ctx->segcontl, vp->segconti);
+    Elem_move_ctx((Elem*)segcontp->segp, (ElemCtx*)tsrctx);
+    vp->segconti = arll_push(ctx->segcontl, segcontp);
+    assert(vp->segconti != -1);
+}
+
+typedef struct {
+    PMBTask *tp;
+    /* groups of the task, by id */
+    PMVG **gl;
+    /* next group and next spawned task to adopt */
+    unsigned gi;
+    unsigned insi;
+} PMBAdoptFrame;
+
+/* Move everything the tasks built into the target contexts, in the order a
+ * sequential build creates it: the groups of a task up to the point its
+ * spawned task would have been built, the ones of the spawned task, and so on.
+ * The ids, the segment indices and the order of the group and segment lists
+ * are the same as with PMV_build_graph().
+ * @return MP_ok on success, MP_mem on memory allocation issues */
+static int _mt_adopt(PMBPool *poolp, PMContext *ctx, TaskSegRawCtx *tsrctx)
+{
+    arll *stack = arll_construct(sizeof(PMBAdoptFrame), 16);
+    if (!stack) return MP_mem;
+    PMBAdoptFrame fr = { .tp = *(PMBTask**)arll_geti(poolp->taskl, 0) };
+    PMBTask *tp = fr.tp;
+    Elem *ep;
+
+    while (1) {
+        if (tp) {
+            /* entering a task */
+            if (tp != fr.tp) _mt_check(poolp->parsctx, tp);
+            /* one more, so that no allocation is empty */
+            fr = (PMBAdoptFrame){
+                .tp = tp,
+                .gl = malloc((tp->ctx->gctx.gid_curr + 1) * sizeof(*fr.gl))
+            };
+            if (!fr.gl) goto nomem;
+            for (ep = tp->ctx->gctx._super.elem_dll; ep; ep = ep->next_p)
+                fr.gl[((PMVG*)ep)->id] = (PMVG*)ep;
+            tp = NULL;
+        }
+
+        PMBInsert *insp = fr.insi < arll_len(fr.tp->insl) ?
+            arll_geti(fr.tp->insl, fr.insi) : NULL;
+        unsigned gend = insp ? insp->gcnt : fr.tp->ctx->gctx.gid_curr;
+        while (fr.gi < gend)
+            _mt_adopt_group(ctx, tsrctx, fr.tp, fr.gl[fr.gi++]);
+
+        if (insp) {
+            fr.insi++;
+            if (arll_push(stack, &fr) == -1) goto nomem;
+            tp = insp->taskp;
+            continue;
         }
-        currgp = (PMVG*)currgp->_super.next_p;
+
+        /* task done */
+        for (int i = 0; i < PMV_enumsize; i++)
+            ctx->pmvcnt[i] += fr.tp->ctx->pmvcnt[i];
+        free(fr.gl);
+        if (arll_pop(stack, &fr)) break;
+    }
+
+    arll_destroy(stack);
+    return MP_ok;
+
+nomem:
+    free(fr.gl);
+    while (!arll_pop(stack, &fr)) free(fr.gl);
+    arll_destroy(stack);
+    return MP_mem;
+}
+
+/* Release the tasks of a pool. The vertices, groups and segment weights they
+ * built are handed over to the target contexts in any case, those not adopted
+ * can then only be released with the contexts. */
+static void _mt_release(PMBPool *poolp, PMContext *ctx)
+{
+    PMBTask **tpp;
+    arll_rewind(poolp->taskl);
+    while ((tpp = arll_next(poolp->taskl))) {
+        PMBTask *tp = *tpp;
+        Elem *ep;
+        while ((ep = tp->tsrctx._super._super.elem_dll)) {
+            Object_deinit((Object*)ep);
+            _obj_free(ep);
+        }
+        TaskSegRawCtx_absorb(poolp->tsrctx, &tp->tsrctx);
+        slab_absorb(ctx->pmv_slab, tp->ctx->pmv_slab);
+        slab_absorb(ctx->pmvg_slab, tp->ctx->pmvg_slab);
+        PMContext_destroy(tp->ctx);
+        arll_destroy(tp->insl);
+        free(tp);
+    }
+}
+
+/* Build a PPM graph from a parser context, using several threads. The child
+ * branches of the forks are built in parallel when they count at least
+ * 'min_tasks' tasks. The resulting graph, group ids, segment indices and
+ * object lists included, is the same as with PMV_build_graph().
+ * @param parsctx pointer to a parser context that contains the parsed model
+ * @param pm_ctx PM context where the graph will be created
+ * @param tsrctx TaskSegRaw context pointer for storing the segments
+ * @param nthreads number of threads, the calling one included
+ * @param min_tasks minimum number of tasks of a branch built in parallel, 0
+ *  for PMV_BUILD_MT_MIN_TASKS
+ * @return 0 on success, MP_err if the model has no start, MP_mem on memory
+ *  allocation issues */
+int PMV_build_graph_mt(
+    MParser *parsctx,
+    PMContext *pm_ctx,
+    TaskSegRawCtx *tsrctx,
+    unsigned nthreads,
+    unsigned long min_tasks)
+{
+    assert(parsctx && pm_ctx && tsrctx);
+    MPTask ct = MParser_get_task(parsctx, parsctx->head);
+
+    if (ct.ttype != MPTT_start) return MP_err;
+    if (!ct.next[0]) return MP_err;
+    if (!nthreads) nthreads = 1;
+    if (!min_tasks) min_tasks = PMV_BUILD_MT_MIN_TASKS;
+
+    PMBPool pool = {
+        .parsctx = parsctx,
+        .tsrctx = tsrctx,
+        .spawnm = ulmap_construct(sizeof(char), 64),
+        .taskl = arll_construct(sizeof(PMBTask*), 64),
+        .queue = arll_construct(sizeof(PMBTask*), 64)
+    };
+    int res = MP_mem;
+    if (!pool.spawnm || !pool.taskl || !pool.queue) goto out;
+    pthread_mutex_init(&pool.mtx, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    res = _mt_plan(parsctx, ct.next[0], min_tasks, pool.spawnm);
+    if (res != MP_ok) goto out_sync;
+    res = MP_mem;
+    if (!_mt_spawn(&pool, 0, ct.next[0], &pm_ctx->headp)) goto out_sync;
+
+    pthread_t *thr_l = malloc(nthreads * sizeof(*thr_l));
+    if (!thr_l) goto out_sync;
+    unsigned started;
+    for (started = 1; started < nthreads; started++) {
+        if (pthread_create(&thr_l[started], NULL, _mt_worker, &pool))
+            break;
+    }
+    _mt_worker(&pool);
+    for (unsigned i = 1; i < started; i++)
+        pthread_join(thr_l[i], NULL);
+    free(thr_l);
+
+    PMBTask **tpp;
+    res = MP_ok;
+    arll_rewind(pool.taskl);
+    while ((tpp = arll_next(pool.taskl)))
+        if ((*tpp)->res != MP_ok) res = (*tpp)->res;
+    if (res == MP_ok) res = _mt_adopt(&pool, pm_ctx, tsrctx);
+    if (res == MP_ok && (pm_ctx->flags & PMF_hashcons))
+        res = _hashcons(pm_ctx);
+    if (res == MP_ok) {
+        parsctx->cti = (*(PMBTask**)arll_geti(pool.taskl, 0))->end_ti;
+        assert(pm_ctx->headp);
+        PMV_eval_r(pm_ctx->headp, 1);
+    }
+
+out_sync:
+    _mt_release(&pool, pm_ctx);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.mtx);
+out:
+    if (pool.spawnm) ulmap_destroy(pool.spawnm);
+    if (pool.taskl) arll_destroy(pool.taskl);
+    if (pool.queue) arll_destroy(pool.queue);
+    return res;
+}
+
+/* Streaming build.
+ * A cursor is a position in the model where the builder waits for a task to
+ * continue from. A frame is an inosculation vertex whose branches are still
+ * being built. Tasks read ahead of their predecessor are kept in the 'pending'
+ * map, the cursors waiting for a task not read yet in the 'awaiting' map. */
+typedef struct PMSFrame PMSFrame;
+typedef struct PMSCursor PMSCursor;
+
+struct PMSCursor {
+    Elem        _super;
+    /* where the next vertex is linked */
+    PMV         **prevnpp;
+    /* segment vertex being filled, if any */
+    PMV         *segv;
+    Segcont     segcont;
+    /* frame of the branch built by the cursor, NULL on the top level */
+    PMSFrame    *framep;
+    /* joins of empty forks, still to be skipped */
+    unsigned    skip_join;
+    /* task to be processed */
+    TaskNo      tno;
+    MPTask      ct;
+    /* next cursor waiting for the same task, or ready to run */
+    PMSCursor   *waitnp;
+};
+
+struct PMSFrame {
+    Elem        _super;
+    PMV         *nv;
+    TaskNo      fork_tno;
+    unsigned long fork_lno;
+    /* number of finished branches, and the join reached by the first one */
+    unsigned    done;
+    TaskNo      join_tno;
+    MPTask      join;
+    /* cursor continuing after the join */
+    PMSCursor   *contp;
+};
+
+typedef struct {
+    MParser         *parsctx;
+    PMContext       *pmctx;
+    TaskSegRawCtx   *tsrctx;
+    ulmap           *pending;
+    ulmap           *awaiting;
+    ElemCtx         cursors;
+    ElemCtx         frames;
+    /* cursors whose task is at hand */
+    PMSCursor       *readyp;
+    char            done;
+} PMStream;
+
+static PMSCursor *_stream_cursor(
+    PMStream *sp,
+    PMV **prevnpp,
+    PMSFrame *framep,
+    const PMSCursor *fromp)
+{
+    PMSCursor *cp = _obj_alloc(sizeof(*cp));
+    if (!cp) return NULL;
+    assert(!Elem_init(&sp->cursors, (Elem*)cp));
+
+    cp->prevnpp = prevnpp;
+    cp->framep = framep;
+    /* for error reporting */
+    cp->tno = fromp->tno;
+    cp->ct = fromp->ct;
+    return cp;
+}
+
+static void _stream_release(void *objp)
+{
+    Object_deinit((Object*)objp);
+    _obj_free(objp);
+}
+
+static void _stream_seg_close(PMStream *sp, PMSCursor *cp)
+{
+    TSR_eval((TaskSegRaw*)cp->segcont.segp);
+    cp->segv->segconti = arll_push(sp->pmctx->segcontl, &cp->segcont);
+    assert(cp->segv->segconti != -1);
+    cp->prevnpp = &cp->segv->np;
+    cp->segv = NULL;
+}
+
+/* Make cursor 'cp' continue with task 'tno': ready to run if the task is at
+ * hand, waiting for it otherwise. */
+static int _stream_await(PMStream *sp, PMSCursor *cp, TaskNo tno)
+{
+    if (!tno) {
+        printf(
+            "[Error][PMV][build_graph_stream]: task %lu(lno=%lu) has no "
+            "successor.\n",
+            cp->tno, cp->ct.lno);
+        return MP_err;
+    }
+    cp->tno = tno;
+
+    PMSFrame *fp = cp->framep;
+    MPTask *tp = ulmap_get(sp->pending, tno);
+    if (fp && fp->done && fp->join_tno == tno) {
+        /* the other branch already met the join */
+        cp->ct = fp->join;
+    } else if (tp) {
+        cp->ct = *tp;
+        ulmap_del(sp->pending, tno);
+    } else {
+        PMSCursor **cpp = ulmap_put(sp->awaiting, tno);
+        if (!cpp) return MP_mem;
+        cp->waitnp = *cpp;
+        *cpp = cp;
+        return 0;
+    }
+
+    cp->waitnp = sp->readyp;
+    sp->readyp = cp;
+    return 0;
+}
+
+static int _stream_seg_put(PMStream *sp, PMSCursor *cp)
+{
+    MParser *parsctx = sp->parsctx;
+    MPTask *ctp = &cp->ct;
+    TSRTask csegt;
+
+    if (!cp->segv) {
+        cp->segv = PMV_create(sp->pmctx, PMV_seg, cp->prevnpp);
+        *cp->prevnpp = cp->segv;
+        cp->segcont.segp = _obj_alloc(sizeof(TaskSegRaw));
+        assert(cp->segcont.segp);
+        assert(!TaskSegRaw_init(sp->tsrctx, (TaskSegRaw*)cp->segcont.segp));
+        cp->segcont.pid = ctp->pno;
+    }
+
+    if (ctp->ttype == MPTT_calc) {
+        csegt.type = TSTT_calc;
+        csegt.req = ctp->req < parsctx->cap_val_cal ?
+            ctp->req : parsctx->cap_val_cal;
+    } else {
+        csegt.type = TSTT_com;
+        csegt.req = ctp->req < parsctx->cap_val_com ?
+            ctp->req : parsctx->cap_val_com;
+    }
+
+    if (ctp->pno != cp->segcont.pid) {
+        printf(
+            "[Error][PMV][build_graph_stream]: task %lu has pid=%d "
+            "but the segment has pid=%d\n",
+            cp->tno,
+            ctp->pno,
+            cp->segcont.pid);
+        return MP_err;
+    }
+    if (TSR_put((TaskSegRaw*)cp->segcont.segp, csegt) != TSR_ok)
+        return MP_mem;
+
+    return _stream_await(sp, cp, ctp->next[0]);
+}
+
+static int _stream_fork(PMStream *sp, PMSCursor *cp)
+{
+    PMV *nv = PMV_create(sp->pmctx, PMV_insc, cp->prevnpp);
+    *cp->prevnpp = nv;
+
+    PMSFrame *fp = _obj_alloc(sizeof(*fp));
+    if (!fp) return MP_mem;
+    assert(!Elem_init(&sp->frames, (Elem*)fp));
+    fp->nv = nv;
+    fp->fork_tno = cp->tno;
+    fp->fork_lno = cp->ct.lno;
+    /* suspended until both the branches meet */
+    fp->contp = cp;
+    cp->prevnpp = &nv->np;
+
+    PMSCursor *pcp = _stream_cursor(sp, &nv->pp, fp, cp);
+    PMSCursor *ccp = _stream_cursor(sp, &nv->cp, fp, cp);
+    if (!pcp || !ccp) return MP_mem;
+
+    int res = _stream_await(sp, pcp, cp->ct.next[0]);
+    if (res) return res;
+    return _stream_await(sp, ccp, cp->ct.next[1]);
+}
+
+static int _stream_join(PMStream *sp, PMSCursor *cp)
+{
+    PMSFrame *fp = cp->framep;
+    TaskNo tno = cp->tno;
+    MPTask join = cp->ct;
+
+    _stream_release(cp);
+    if (fp->done++ == 0) {
+        fp->join_tno = tno;
+        fp->join = join;
+        return 0;
+    }
+
+    if (fp->join_tno != tno) {
+        printf(
+            "[Error][PMV][build_graph_stream]: on fork %lu(lno=%lu), branches "
+            "don't meet: parent join=%lu(lno=%lu), child join=%lu(lno=%lu)\n",
+            fp->fork_tno, fp->fork_lno,
+            fp->join_tno, fp->join.lno,
+            tno, join.lno);
+        return MP_err;
+    }
+    if (!fp->nv->pp || !fp->nv->cp) {
+        printf(
+            "[Error][PMV][build_graph_stream]: on fork %lu(lno=%lu), %s branch "
+            "empty.\n",
+            fp->fork_tno, fp->fork_lno, fp->nv->pp ? "child" : "parent");
+        return MP_err;
+    }
+
+    cp = fp->contp;
+    cp->tno = tno;
+    cp->ct = join;
+    _stream_release(fp);
+
+    return _stream_await(sp, cp, join.next[0]);
+}
+
+/* Process the task at hand of cursor 'cp'. */
+static int _stream_step(PMStream *sp, PMSCursor *cp)
+{
+    MPTask *ctp = &cp->ct;
+
+    /* anything but calculation and communication ends the segment */
+    if (cp->segv && ctp->ttype != MPTT_calc && ctp->ttype != MPTT_com)
+        _stream_seg_close(sp, cp);
+
+    switch (ctp->ttype) {
+    case MPTT_calc:
+    case MPTT_com:
+        return _stream_seg_put(sp, cp);
+
+    case MPTT_fork:
+        if (ctp->next[1])
+            return _stream_fork(sp, cp);
+        /* empty fork, ignore it and its join */
+        cp->skip_join++;
+        return _stream_await(sp, cp, ctp->next[0]);
+
+    case MPTT_forkend:
+        return _stream_await(sp, cp, ctp->next[0]);
+
+    case MPTT_join:
+        if (cp->skip_join) {
+            cp->skip_join--;
+            return _stream_await(sp, cp, ctp->next[0]);
+        }
+        if (cp->framep)
+            return _stream_join(sp, cp);
+        printf(
+            "[Error][PMV][build_graph_stream]: join %lu(lno=%lu) outside of "
+            "a fork.\n",
+            cp->tno, ctp->lno);
+        return MP_err;
+
+    case MPTT_end:
+        if (cp->framep) {
+            printf(
+                "[Error][PMV][build_graph_stream]: end %lu(lno=%lu) inside "
+                "the branch of fork %lu.\n",
+                cp->tno, ctp->lno, cp->framep->fork_tno);
+            return MP_err;
+        }
+        _stream_release(cp);
+        sp->done = 1;
+        return 0;
+
+    case MPTT_start:
+        printf(
+            "[Error][PMV][build_graph_stream]: task %lu, is of type 'start'.\n",
+            cp->tno);
+        return MP_err;
+
+    default:
+        return MP_err;
+    }
+}
+
+/* Feed a task read from the model to the builder. */
+static int _stream_feed(PMStream *sp, TaskNo tno, const MPTask *ctp)
+{
+    PMSCursor **cpp = ulmap_get(sp->awaiting, tno);
+
+    if (cpp) {
+        PMSCursor *cp = *cpp;
+        ulmap_del(sp->awaiting, tno);
+        if (cp->waitnp && ctp->ttype != MPTT_join) {
+            printf(
+                "[Error][PMV][build_graph_stream]: task %lu(lno=%lu) has more "
+                "than one predecessor.\n",
+                tno, ctp->lno);
+            return MP_err;
+        }
+        while (cp) {
+            PMSCursor *nextp = cp->waitnp;
+            cp->ct = *ctp;
+            cp->waitnp = sp->readyp;
+            sp->readyp = cp;
+            cp = nextp;
+        }
+        return 0;
+    }
+
+    if (ulmap_get(sp->pending, tno)) {
+        printf(
+            "[Error][PMV][build_graph_stream]: task %lu(lno=%lu) defined "
+            "twice.\n",
+            tno, ctp->lno);
+        return MP_err;
+    }
+    MPTask *tp = ulmap_put(sp->pending, tno);
+    if (!tp) return MP_mem;
+    *tp = *ctp;
+
+    if (ulmap_len(sp->pending) > sp->parsctx->stat_window)
+        sp->parsctx->stat_window = ulmap_len(sp->pending);
+    return 0;
+}
+
+typedef struct {
+    unsigned *gidp;
+    arll *segcontl;
+} PMRenumber;
+
+static PMWRes _renumber_pre(PMWalk *walkp, PMV *vp)
+{
+    PMRenumber *rnp = walkp->arg;
+    vp->gp->id = (*rnp->gidp)++;
+    Elem_move_head((Elem*)vp->gp);
+
+    switch (vp->type) {
+    case PMV_seg: {
+        Segcont *segcontp = arll_geti(vp->ctxp->segcontl, vp->segconti);
+        Elem_move_head((Elem*)segcontp->segp);
+        vp->segconti = arll_push(rnp->segcontl, segcontp);
+        assert(vp->segconti != -1);
+        break;
+    }
+    case PMV_insc:
+        break;
+    default:
+        assert(0);
+    }
+    return PMW_cont;
+}
+
+/* Number the groups and the segments of a graph depth-first, parent branch
+ * before child branch, i.e. in the order PMV_build_graph() creates them. The
+ * group list and the segment context are reordered accordingly. */
+static void _renumber(PMV *vp, unsigned *gidp, arll *segcontl)
+{
+    PMRenumber rn = { .gidp = gidp, .segcontl = segcontl };
+    PMWalk walk = { .pre = _renumber_pre, .arg = &rn };
+    PMV_walk(&walk, vp);
+}
+
+/* Build a PPM graph reading the model as a stream of tasks, without the task
+ * list of the parser context. A task is fed to the builder as soon as its
+ * predecessor has been, tasks read ahead of their predecessor are kept aside
+ * until then. For models written in roughly topological order, only a small
+ * window of tasks is held in memory (its peak is found in 'stat_window' of the
+ * parser context). The resulting graph is the same as built by
+ * PMV_build_graph(), group ids and segment order included.
+ * @param parsctx pointer to a parser context set up by MParser_init_stream()
+ * @param pm_ctx PM context where the graph will be created
+ * @param tsrctx TaskSegRaw context pointer for storing the segments
+ * @return 0 on success, MP_err on model corruption or IO error, MP_mem on
+ *  memory allocation issues */
+int PMV_build_graph_stream(
+    MParser *parsctx,
+    PMContext *pm_ctx,
+    TaskSegRawCtx *tsrctx)
+{
+    assert(parsctx && pm_ctx && tsrctx);
+
+    PMStream s = {
+        .parsctx = parsctx,
+        .pmctx = pm_ctx,
+        .tsrctx = tsrctx,
+        .pending = ulmap_construct(sizeof(MPTask), 1024),
+        .awaiting = ulmap_construct(sizeof(PMSCursor*), 64)
+    };
+    assert(!ElemCtx_init(&s.cursors));
+    assert(!ElemCtx_init(&s.frames));
+
+    PMSCursor start = { 0 };
+    char started = 0;
+    int res = s.pending && s.awaiting ? 0 : MP_mem;
+
+    while (!res) {
+        MPRes pres = MParser_stream_next(parsctx, &start.tno, &start.ct);
+        if (pres == MP_eof) break;
+        if (pres != MP_ok) {
+            res = pres;
+            break;
+        }
+
+        if (start.ct.ttype != MPTT_start) {
+            res = _stream_feed(&s, start.tno, &start.ct);
+        } else if (started++) {
+            printf(
+                "[Error][PMV][build_graph_stream]: second 'start' task %lu"
+                "(lno=%lu).\n",
+                start.tno, start.ct.lno);
+            res = MP_err;
+        } else {
+            PMSCursor *cp = _stream_cursor(&s, &pm_ctx->headp, NULL, &start);
+            res = cp ? _stream_await(&s, cp, start.ct.next[0]) : MP_mem;
+        }
+
+        while (!res && s.readyp) {
+            PMSCursor *cp = s.readyp;
+            s.readyp = cp->waitnp;
+            res = _stream_step(&s, cp);
+        }
+    }
+
+    if (!res && !s.done) {
+        printf(
+            "[Error][PMV][build_graph_stream]: model incomplete, %s.\n",
+            started ? "tasks missing" : "no 'start' task");
+        res = MP_err;
+
+        /* the first reference to a task not read */
+        for (Elem *ep = s.cursors.elem_dll; ep; ep = ep->next_p) {
+            PMSCursor *cp = (PMSCursor*)ep;
+            if (!ulmap_get(s.awaiting, cp->tno)) continue;
+            if (!parsctx->err_lno || cp->ct.lno < parsctx->err_lno)
+                parsctx->err_lno = cp->ct.lno;
+        }
+    }
+
+    /* keep the partial graph consistent */
+    for (Elem *ep = s.cursors.elem_dll; ep; ep = ep->next_p)
+        if (((PMSCursor*)ep)->segv) _stream_seg_close(&s, (PMSCursor*)ep);
+    Object_deinit((Object*)&s.cursors);
+    Object_deinit((Object*)&s.frames);
+    ulmap_destroy(s.pending);
+    ulmap_destroy(s.awaiting);
+
+    if (res) return res;
+
+    arll *segcontl = arll_construct(sizeof(Segcont), 64);
+    assert(segcontl);
+    pm_ctx->gctx.gid_curr = 0;
+    _renumber(pm_ctx->headp, &pm_ctx->gctx.gid_curr, segcontl);
+    arll_destroy(pm_ctx->segcontl);
+    pm_ctx->segcontl = segcontl;
+
+    if ((pm_ctx->flags & PMF_hashcons) && _hashcons(pm_ctx) != MP_ok)
+        return MP_mem;
+    PMV_eval_r(pm_ctx->headp, 1);
+
+    return 0;
+}
+
+/* Deinit and deallocate a context previously allocated by PMContext_create()
+ * @param ctx pointer to a context*/
+void PMContext_destroy(PMContext *ctx)
+{
+    if (!ctx) return;
+
+    /* only the member lists moved to the heap are freed one by one, the
+     * vertices and the groups are released with their slabs */
+    for (Elem *ep = ctx->gctx._super.elem_dll; ep; ep = ep->next_p)
+        arll_deinit(((PMVG*)ep)->vpl);
+    PMVG **gpp;
+    arll_rewind(ctx->gmergedl);
+    while ((gpp = arll_next(ctx->gmergedl)))
+        arll_deinit((*gpp)->vpl);
+    arll_destroy(ctx->gmergedl);
+    arll_destroy(ctx->clsl);
+    ulmap_destroy(ctx->clsm);
+    PMContext_thaw(ctx);
+    slab_destroy(ctx->pmvg_slab);
+    slab_destroy(ctx->pmv_slab);
+    arll_destroy(ctx->segcontl);
+    gplot_destroy(ctx->gplot);
+    free(ctx);
+}
+
+static const PM_seg_summary pmsegsummary_zero = { 0 };
+
+static TaskSeg_summary *_get_seg_summary(PMContext *ctx)
+{
+    assert(ctx);
+    const PMFrozen *fzp = PMContext_freeze(ctx);
+    unsigned segcnt = fzp->segcnt;
+
+    TaskSeg_summary *tss = malloc(sizeof(*tss) * segcnt);
+    assert(tss);
+
+    for (unsigned ci = 0; ci < segcnt; ci++) {
+        Segcont *segcontp = (Segcont*)arll_geti(ctx->segcontl, fzp->segl[ci]);
+        assert(segcontp);
+        tss[ci] = TaskSeg_eval(segcontp->segp);
     }
-    assert(ci == segcnt);
 
     return tss;
 }
 
+/* @return the first group of the group list of a PM context. The members of
+ * the merged groups are moved to their groups first.
+ * @param pmctx pointer to a PM context */
+PMVG *PMContext_get_grouplist(PMContext *pmctx)
+{
+    assert(pmctx);
+    PMContext_flush_groups(pmctx);
+    return (PMVG*)(pmctx->gctx._super).elem_dll;
+}
+
+static PMWRes _freeze_pre(PMWalk *walkp, PMV *vp)
+{
+    PMFrozen *fzp = walkp->arg;
+    PMFV v = fzp->cnt++;
+    uint8_t shape = vp->type;
+
+    switch (vp->type) {
+    case PMV_seg:
+        fzp->segl[fzp->segcnt++] = vp->segconti;
+        break;
+    case PMV_insc:
+        if (vp->pp) shape |= PMFZ_B1;
+        if (vp->cp) shape |= PMFZ_B2;
+        break;
+    case PMV_wrap:
+        if (vp->wp) shape |= PMFZ_B1;
+        break;
+    default:
+        assert(0);
+    }
+    if (vp->np) shape |= PMFZ_NP;
+
+    fzp->shape[v] = shape;
+    fzp->vpl[v] = vp;
+    return PMW_cont;
+}
+
+/* Lay the tree of a PM context out, unless it is already, without the groups.
+ * @param ctx pointer to a PM context
+ * @return pointer to the frozen layout, owned by the context */
+static PMFrozen *_freeze_tree(PMContext *ctx)
+{
+    if (ctx->frozen) return ctx->frozen;
+
+    unsigned vcntl[PMV_enumsize];
+    PMContext_get_vcnt(ctx, vcntl);
+    /* vertices left out of the tree are counted as well */
+    const uint32_t cap = vcntl[PMV_seg] + vcntl[PMV_insc] + vcntl[PMV_wrap];
+
+    PMFrozen *fzp = calloc(1, sizeof(*fzp));
+    assert(fzp);
+    /* one more, so that no allocation is empty */
+    fzp->shape = malloc(sizeof(*fzp->shape) * (cap + 1));
+    fzp->end = malloc(sizeof(*fzp->end) * (cap + 1));
+    fzp->vpl = malloc(sizeof(*fzp->vpl) * (cap + 1));
+    fzp->segl = malloc(sizeof(*fzp->segl) * (vcntl[PMV_seg] + 1));
+    assert(fzp->shape && fzp->end && fzp->vpl && fzp->segl);
+    ctx->frozen = fzp;
+
+    PMWalk walk = { .pre = _freeze_pre, .arg = fzp };
+    PMV_walk(&walk, ctx->headp);
+    assert(fzp->cnt <= cap);
+
+    /* the trees of the links lie after the vertex, the next vertex last */
+    for (PMFV v = fzp->cnt; v-- > 0;) {
+        const uint8_t shape = fzp->shape[v];
+        if (shape & PMFZ_NP)        fzp->end[v] = fzp->end[PMFrozen_np(fzp, v)];
+        else if (shape & PMFZ_B2)   fzp->end[v] = fzp->end[PMFrozen_b2(fzp, v)];
+        else if (shape & PMFZ_B1)   fzp->end[v] = fzp->end[v + 1];
+        else                        fzp->end[v] = v + 1;
+    }
+
+    return fzp;
+}
+
+/* Lay the tree of a PM context out in walk order, see PMFrozen, without the
+ * groups and the class index. For the readers of the tree structure only,
+ * such as PMCompact. The layout is dropped as soon as the tree changes.
+ * @param ctx pointer to a PM context
+ * @return pointer to the frozen layout, owned by the context */
+const PMFrozen *PMContext_layout(PMContext *ctx)
+{
+    assert(ctx);
+    return _freeze_tree(ctx);
+}
+
+/* Freeze the tree of a PM context: lay it out in walk order, see PMFrozen.
+ * The passes reading the finished tree (statistics and export) run on the
+ * layout as linear scans. The layout is kept until the tree changes, a group
+ * merge only drops the groups, which are filled again here.
+ * @param ctx pointer to a PM context
+ * @return pointer to the frozen layout, owned by the context */
+const PMFrozen *PMContext_freeze(PMContext *ctx)
+{
+    assert(ctx);
+    PMContext_flush_groups(ctx);
+    PMFrozen *fzp = _freeze_tree(ctx);
+    if (fzp->gpl) return fzp;
+
+    /* one more, so that no allocation is empty */
+    fzp->gpl = malloc(sizeof(*fzp->gpl) * (fzp->cnt + 1));
+    assert(fzp->gpl);
+    for (PMFV v = 0; v < fzp->cnt; v++)
+        fzp->gpl[v] = fzp->vpl[v]->gp;
+
+    return fzp;
+}
+
+/* Freeze the tree of a PM context, see PMContext_freeze(), and index its
+ * vertices by their tree classes, see PMFrozen.clsv. The index is kept with
+ * the layout, group merges leave both as they are. The groups of the layout
+ * are left out, as they would not last through mining.
+ * @param ctx pointer to a PM context, its tree evaluated
+ * @return pointer to the frozen layout, owned by the context */
+const PMFrozen *PMContext_index(PMContext *ctx)
+{
+    assert(ctx);
+    PMFrozen *fzp = _freeze_tree(ctx);
+    if (fzp->clsv) return fzp;
+
+    const uint32_t clscnt = arll_len(ctx->clsl);
+    fzp->clscnt = clscnt;
+    fzp->clsoff = calloc(clscnt + 1, sizeof(*fzp->clsoff));
+    fzp->clsv = malloc(sizeof(*fzp->clsv) * (fzp->cnt + 1));
+    assert(fzp->clsoff && fzp->clsv);
+
+    /* counting sort, which keeps the vertices of a class in layout order */
+    for (PMFV v = 0; v < fzp->cnt; v++) {
+        assert(fzp->vpl[v]->cls < clscnt);
+        fzp->clsoff[fzp->vpl[v]->cls + 1]++;
+    }
+    for (uint32_t c = 0; c < clscnt; c++)
+        fzp->clsoff[c + 1] += fzp->clsoff[c];
+    for (PMFV v = 0; v < fzp->cnt; v++)
+        fzp->clsv[fzp->clsoff[fzp->vpl[v]->cls]++] = v;
+    /* the offsets were moved to the ends of the classes, shift them back */
+    for (uint32_t c = clscnt; c > 0; c--)
+        fzp->clsoff[c] = fzp->clsoff[c - 1];
+    fzp->clsoff[0] = 0;
+
+    return fzp;
+}
+
 /* Evaluate statistics of a PM context.
  * @param ctx pointer to a PM context
  * @return PM_seg_summary structure containing the statistics */
@@ -1065,10 +2917,7 @@ PM_seg_summary PMContext_eval(PMContext *ctx)
 {
     assert(ctx);
     PM_seg_summary retval = pmsegsummary_zero;
-
-    unsigned vcntl[PMV_enumsize];
-    PMContext_get_vcnt(ctx, vcntl);
-    unsigned segcnt = vcntl[PMV_seg];
+    unsigned segcnt = PMContext_freeze(ctx)->segcnt;
     double *fl = malloc(sizeof(*fl) * segcnt);
     assert(fl);
 
@@ -1142,41 +2991,50 @@ PM_seg_summary PMContext_eval(PMContext *ctx)
 //    _check_tree(ctx->headp);
 //}
 
-static PMVG* _link_groups(PMV *vp)
+/* Set a group link, unless already set.
+ * @return 1 if the link was set now, 0 otherwise */
+static char _link_group(PMVG **linkpp, const PMFrozen *fzp, PMFV v)
 {
-    if (!vp) return NULL;
-    /* if pointers not null, it means the node was already visited, so descends
-     * can be spared */
-    PMVG *gp = vp->gp;
-    switch (vp->type) {
-    case PMV_seg:
-        break;
-
-    case PMV_insc:
-        if (!gp->cpmv.pp) gp->cpmv.pp = _link_groups(vp->pp);
-        if (!gp->cpmv.cp) gp->cpmv.cp = _link_groups(vp->cp);
-        break;
-
-    case PMV_wrap:
-        if (!gp->cpmv.wp) gp->cpmv.wp = _link_groups(vp->wp);
-        break;
-
-    default:
-        assert(0);
-        break;
-    }
-
-    if (!gp->cpmv.np) gp->cpmv.np = _link_groups(vp->np);
-    return gp;
+    if (*linkpp || v == PMFV_nil) return 0;
+    *linkpp = fzp->gpl[v];
+    return 1;
 }
 
 /* Link the PMV groups of a PPM graph. The resulting graph represents the
- * compressed graph.
+ * compressed graph. Each group is linked to the groups of the vertices its
+ * member points to. The members of a group are similar, so once a group is
+ * linked, the trees of its other members are skipped.
  * @param ctx pointer to a PM context*/
 void PM_link_groups(PMContext *ctx)
 {
     assert(ctx);
-    _link_groups(ctx->headp);
+    const PMFrozen *fzp = PMContext_freeze(ctx);
+
+    for (PMFV v = 0; v < fzp->cnt;) {
+        PMVG *gp = fzp->gpl[v];
+        char linked = 0;
+
+        switch (fzp->shape[v] & PMFZ_TYPE) {
+        case PMV_seg:
+            break;
+
+        case PMV_insc:
+            linked |= _link_group(&gp->cpmv.pp, fzp, PMFrozen_b1(fzp, v));
+            linked |= _link_group(&gp->cpmv.cp, fzp, PMFrozen_b2(fzp, v));
+            break;
+
+        case PMV_wrap:
+            linked |= _link_group(&gp->cpmv.wp, fzp, PMFrozen_b1(fzp, v));
+            break;
+
+        default:
+            assert(0);
+            break;
+        }
+
+        linked |= _link_group(&gp->cpmv.np, fzp, PMFrozen_np(fzp, v));
+        v = linked ? v + 1 : fzp->end[v];
+    }
 }
 
 typedef struct __attribute__((__packed__)) {
@@ -1189,36 +3047,17 @@ typedef struct __attribute__((__packed__)) {
     uint32_t pid;
 } Segcont_pckd;
 
-static unsigned _segcont_l_pack(
-    PMV *vp,
-    Segcont_pckd *contl_pck,
-    unsigned i)
+/* Pack the segment containers of the tree, in walk order.
+ * @return number of packed containers */
+static unsigned _segcont_l_pack(PMContext *ctx, Segcont_pckd *contl_pck)
 {
-    if (!vp) return i;
-
-    Segcont cont;
-    switch (vp->type) {
-    case PMV_seg:
-        cont = PMV_getseg(vp);
+    const PMFrozen *fzp = PMContext_freeze(ctx);
+    for (uint32_t i = 0; i < fzp->segcnt; i++) {
+        Segcont cont = *(Segcont*)arll_geti(ctx->segcontl, fzp->segl[i]);
         contl_pck[i].pid = cont.pid;
         contl_pck[i].segid = ((Elem*)cont.segp)->idx;
-        i++;
-        break;
-
-    case PMV_insc:
-        i = _segcont_l_pack(vp->pp, contl_pck, i);
-        i = _segcont_l_pack(vp->cp, contl_pck, i);
-        break;
-
-    case PMV_wrap:
-        i = _segcont_l_pack(vp->wp, contl_pck, i);
-        break;
-
-    default:
-        assert(0);
     }
-
-    return _segcont_l_pack(vp->np, contl_pck, i);
+    return fzp->segcnt;
 }
 
 /*
@@ -1249,7 +3088,7 @@ static int _segcont_l_to_file(PMContext *ctx, FILE *wfp, TaskSegCtx *segctx)
     assert(contl);
 
     ElemCtx_assign_idx((ElemCtx*)segctx);
-    assert(_segcont_l_pack(ctx->headp, contl, 0) == lpckd.size);
+    assert(_segcont_l_pack(ctx, contl) == lpckd.size);
 
     assert(fwrite(contl, sizeof(*contl), lpckd.size, wfp) == lpckd.size);
     tot_len += sizeof(*contl) * lpckd.size;
@@ -1303,6 +3142,7 @@ typedef struct __attribute__((__packed__)) {
 static int _pmvg_ctx_to_file(PMContext *ctx, FILE *wfp)
 {
     assert(ctx);
+    PMContext_flush_groups(ctx);
     ElemCtx_assign_idx((ElemCtx*)&ctx->gctx);
     PM_link_groups(ctx);
 
@@ -24,6 +24,8 @@
 #include "TaskSeg.h"
 #include "element_context.h"
 #include "arll.h"
+#include "slab.h"
+#include "ulmap.h"
 #include "gplot.h"
 #include "model_parser.h"
 
@@ -55,6 +57,10 @@ struct CPMV {
     };
 };
 
+/* number of members stored in the group itself, before 'vpl' moves to the
+ * heap */
+#define PMVG_VPL_BUFLEN 2
+
 /* NOT INHERITABLE */
 struct PMVG {
     Elem _super;
@@ -62,6 +68,14 @@ struct PMVG {
     CPMV cpmv;
     /* for debugging */
     unsigned id;
+    /* the group this one was merged into, NULL if not merged. Merged groups
+     * form union-find trees, see PMV_getgroup(). */
+    PMVG *ufp;
+    /* number of member vertices, those of the merged groups included */
+    unsigned size;
+    /* storage of 'vpl' */
+    arll _vpl;
+    PMV *_vpl_buf[PMVG_VPL_BUFLEN];
 };
 
 struct Segcont {
@@ -75,11 +89,15 @@ struct Segcont {
 struct PMV {
     /* Vertex type: segment, inosculation or wrapper */
     PMVType type;
+    /* Number of vertices on the stem, wrapped sections spliced in. Wrappers
+     * do not add. */
+    unsigned    stemlen;
     /* next vertex */
     PMV *np;
     /* pointer to the pointer to this vertex */
     PMV **prevnpp;
-    /* pointer to the vertex group */
+    /* pointer to the vertex group. After merges, this may be a group merged
+     * into another one, use PMV_getgroup(). */
     PMVG *gp;
     /* pointer to the PM context */
     PMContext *ctxp;
@@ -87,10 +105,16 @@ struct PMV {
     unsigned    depth;
     /* Number of vertices in the tree. Wrappers do not add. */
     unsigned    vcnt;
-    /* Hash value. Wrappers do not change the hash. */
-    uint32_t    hash;
+    /* Hash value of the tree, sensitive to the order of the stem and to the
+     * roles of the branches. Wrappers do not change the hash. */
+    uint64_t    hash;
     /* interal flags. !!!! DO NOT USE EXTERNALLY !!!! */
     uint32_t    flags;
+    /* Class of the tree, once evaluated: similar trees are in the same class,
+     * and trees free of wrappers are similar if in the same class. Wrappers
+     * are seen through. 0 stands for the empty tree. Classes are numbered per
+     * PM context and kept for its life, so miners may use them as keys. */
+    uint32_t    cls;
     /* container for external use. As pointer or as unsigned integer. It is
      * initialized to zero and is internally untouched throughout the life of
      * the PM context.*/
@@ -121,15 +145,114 @@ typedef struct {
 
 typedef Elem_VMT PMVG_VMT;
 
+/* build mode flags, see PMContext */
+enum {
+    /* Join the groups of identical subtrees while building: subtrees of the
+     * same shape whose segments hold the very same tasks (see TSR_equal())
+     * share their groups before any mining. */
+    PMF_hashcons    = 0x1
+};
+
+/* vertex index of a frozen tree */
+typedef uint32_t PMFV;
+#define PMFV_nil UINT32_MAX
+
+/* shape bits of a frozen vertex, besides its type */
+#define PMFZ_TYPE   0x03
+/* has a first branch: parent or wrapped */
+#define PMFZ_B1     0x04
+/* has a child branch */
+#define PMFZ_B2     0x08
+/* has a next vertex */
+#define PMFZ_NP     0x10
+
+/* Frozen layout of a PPM tree, see PMContext_freeze(). The vertices are laid
+ * out in the order PMV_walk() visits them: each vertex is followed by its
+ * parent (or wrapped) branch, then by its child branch, then by the rest of
+ * its stem. The tree starting at a vertex thus takes a contiguous range, whose
+ * end is all it takes to find the links. */
+typedef struct {
+    /* number of vertices */
+    uint32_t cnt;
+    /* type and PMFZ_* bits */
+    uint8_t *shape;
+    /* index past the tree starting at the vertex: its branches and the rest
+     * of its stem */
+    PMFV *end;
+    /* the groups of the vertices, NULL until the next PMContext_freeze() after
+     * a group merge or PMContext_index() */
+    PMVG **gpl;
+    /* the vertices of the tree */
+    PMV **vpl;
+    /* number of segment vertices */
+    uint32_t segcnt;
+    /* segment container indices of the segment vertices, in layout order */
+    int *segl;
+    /* the vertices by tree class, see PMContext_index(): those of class c are
+     * clsv[clsoff[c]] up to clsv[clsoff[c + 1]], in layout order. NULL if not
+     * indexed. */
+    PMFV *clsoff;
+    PMFV *clsv;
+    /* number of classes indexed */
+    uint32_t clscnt;
+} PMFrozen;
+
 struct PMContext {
     PMV *headp;
+    /* PMF_* flags, set before building */
+    unsigned flags;
     PMVGCtx gctx;
     arll *segcontl;
     unsigned pmvcnt[PMV_enumsize];
+    /* the vertices and the groups are allocated from these */
+    slab *pmv_slab;
+    slab *pmvg_slab;
+    /* groups merged into others, whose members were not yet moved */
+    arll *gmergedl;
+    /* frozen layout of the tree, NULL if not frozen or changed since */
+    PMFrozen *frozen;
+    /* tree classes, see PMV.cls: the classes by id and their ids by hash */
+    arll *clsl;
+    ulmap *clsm;
     /* for debugging */
     gnuplot *gplot;
 };
 
+/* Return values of the PMV_walk() callbacks */
+typedef enum {
+    /* go on with the walk */
+    PMW_cont,
+    /* ('pre' only) do not walk the branches of the vertex */
+    PMW_prune,
+    /* ('pre' only) leave out the vertex, its branches and the rest of its
+     * stem */
+    PMW_cut,
+    /* end the walk */
+    PMW_stop
+} PMWRes;
+
+typedef struct PMWalk PMWalk;
+typedef PMWRes (*PMWalk_cb)(PMWalk *walkp, PMV *vp);
+
+/* 'post' is called after the rest of the stem as well, i.e. each vertex is
+ * visited after everything it points to */
+#define PMWF_next_first 0x1
+
+/* A walk over a PPM tree, see PMV_walk(). */
+struct PMWalk {
+    /* called when a vertex is reached, can be NULL */
+    PMWalk_cb pre;
+    /* called after the branches of a vertex, can be NULL */
+    PMWalk_cb post;
+    /* PMWF_* flags */
+    unsigned flags;
+    /* for use by the callbacks */
+    void *arg;
+    /* set by PMV_walk_continue() */
+    PMV *_nextp;
+    char _next_set;
+};
+
 /* note: task deviation is the difference between compressed and uncompressed
  * task weight. */
 typedef struct {
@@ -165,10 +288,34 @@ void PMV_find_similar_stem(
     PMV **v2end,
     char check_summary);
 int PMV_is_similar(PMV *v1, PMV *v2, char check_summary);
+PMVG *PMV_getgroup(PMV *vp);
+int PMV_walk(PMWalk *walkp, PMV *vp);
+/* From a 'post' callback: the walk goes on with 'np' instead of the next
+ * vertex of the current one. Ignored with PMWF_next_first. */
+static inline void PMV_walk_continue(PMWalk *walkp, PMV *np)
+{
+    assert(walkp);
+    walkp->_nextp = np;
+    walkp->_next_set = 1;
+}
 void PMV_merge_r(PMV *v1p, PMV *v2p) ;
+int PMVG_merge(PMVG *to, PMVG *from);
 //int CPMVContext_init(CPMVContext *ctx);
 void PMV_plot(PMContext *ctx);
 int PMV_build_graph(MParser *parsctx, PMContext *pm_ctx, TaskSegRawCtx *tsrctx);
+/* default minimum number of tasks of a branch built by its own thread task,
+ * see PMV_build_graph_mt() */
+#define PMV_BUILD_MT_MIN_TASKS 16384
+int PMV_build_graph_mt(
+    MParser *parsctx,
+    PMContext *pm_ctx,
+    TaskSegRawCtx *tsrctx,
+    unsigned nthreads,
+    unsigned long min_tasks);
+int PMV_build_graph_stream(
+    MParser *parsctx,
+    PMContext *pm_ctx,
+    TaskSegRawCtx *tsrctx);
 static Segcont PMV_getseg(PMV* vp) {
     assert(vp);
     assert(vp->type == PMV_seg);
@@ -193,9 +340,34 @@ PM_seg_summary PMContext_eval(PMContext *ctx);
 //void PMContext_check(PMContext *ctx);
 int PMContext_to_file(PMContext *ctx, FILE *wfp, TaskSegCtx *segctx);
 int PMContext_init_gplot(PMContext *pmctx);
-static inline PMVG *PMContext_get_grouplist(PMContext *pmctx)
+PMVG *PMContext_get_grouplist(PMContext *pmctx);
+const PMFrozen *PMContext_layout(PMContext *ctx);
+const PMFrozen *PMContext_freeze(PMContext *ctx);
+const PMFrozen *PMContext_index(PMContext *ctx);
+
+/* @return the first branch (parent or wrapped) of a frozen vertex, PMFV_nil
+ *  if none */
+static inline PMFV PMFrozen_b1(const PMFrozen *fzp, PMFV v)
+{
+    assert(fzp && v < fzp->cnt);
+    return fzp->shape[v] & PMFZ_B1 ? v + 1 : PMFV_nil;
+}
+
+/* @return the child branch of a frozen vertex, PMFV_nil if none */
+static inline PMFV PMFrozen_b2(const PMFrozen *fzp, PMFV v)
+{
+    assert(fzp && v < fzp->cnt);
+    if (!(fzp->shape[v] & PMFZ_B2)) return PMFV_nil;
+    return fzp->shape[v] & PMFZ_B1 ? fzp->end[v + 1] : v + 1;
+}
+
+/* @return the next vertex of a frozen vertex, PMFV_nil if none */
+static inline PMFV PMFrozen_np(const PMFrozen *fzp, PMFV v)
 {
-    assert(pmctx);
-    return (PMVG*)(pmctx->gctx._super).elem_dll;
+    assert(fzp && v < fzp->cnt);
+    if (!(fzp->shape[v] & PMFZ_NP)) return PMFV_nil;
+    if (fzp->shape[v] & PMFZ_B2) return fzp->end[PMFrozen_b2(fzp, v)];
+    if (fzp->shape[v] & PMFZ_B1) return fzp->end[v + 1];
+    return v + 1;
 }
 #endif /* PM_H_ */
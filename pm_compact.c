@@ -0,0 +1,117 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "pm_compact.h"
+#include <stdlib.h>
+
+typedef struct {
+    PMCV v1;
+    PMCV v2;
+} PMCPair;
+
+static const PMCompact pmcompact_zero = { 0 };
+
+/* Create the compact store of a PPM tree, over its frozen layout, see
+ * PMContext_layout().
+ * @param ctx pointer to a PM context holding an evaluated tree
+ * @return pointer to the new store, NULL on memory allocation failure
+ * @pre no wrappers in the tree, i.e. before GM_mine_recurrence() */
+PMCompact *PMCompact_create(PMContext *ctx)
+{
+    assert(ctx);
+    assert(ctx->pmvcnt[PMV_wrap] == 0);
+    PMCompact *cp = malloc(sizeof(*cp));
+    if (!cp) return NULL;
+    *cp = pmcompact_zero;
+    cp->ctx = ctx;
+    cp->fzp = PMContext_layout(ctx);
+    const uint32_t cnt = cp->cnt = cp->fzp->cnt;
+    if (!cnt) return cp;
+
+    cp->flags = calloc(cnt, sizeof(*cp->flags));
+    cp->cls = malloc(sizeof(*cp->cls) * cnt);
+    if (!cp->flags || !cp->cls) {
+        PMCompact_destroy(cp);
+        return NULL;
+    }
+
+    for (PMCV v = 0; v < cnt; v++) {
+        PMV *vp = PMCV_vp(cp, v);
+        cp->cls[v] = vp->cls;
+        if (vp->type == PMV_insc && PMV_insc_is_symm(vp))
+            cp->flags[v] |= PMCV_F_INSC_is_sym;
+    }
+
+    return cp;
+}
+
+/* Destroy a compact store. The frozen layout is left to the PM context.
+ * @param cp pointer to the store, can be NULL */
+void PMCompact_destroy(PMCompact *cp)
+{
+    if (!cp) return;
+    free(cp->flags);
+    free(cp->cls);
+    free(cp);
+}
+
+/* Check if the trees starting at 'v1' and 'v2' are similar, see
+ * PMV_is_similar(). Without wrappers, they are if they are of one class.
+ * @return 1 if similar, 0 otherwise */
+int PMCV_is_similar(const PMCompact *cp, PMCV v1, PMCV v2)
+{
+    assert(cp);
+    assert(cp->ctx->pmvcnt[PMV_wrap] == 0);
+    if (v1 == PMCV_nil || v2 == PMCV_nil) return v1 == v2;
+    return cp->cls[v1] == cp->cls[v2];
+}
+
+/* Merge the groups of the corresponding vertices of two similar trees, see
+ * PMV_merge_r().
+ * @param cp pointer to the store
+ * @param v1 a vertex
+ * @param v2 another vertex
+ * @pre the trees are similar */
+void PMCV_merge(PMCompact *cp, PMCV v1, PMCV v2)
+{
+    assert(cp);
+    PMCPair buf[64];
+    arll stack;
+    arll_init_buf(&stack, sizeof(PMCPair), buf, sizeof(buf) / sizeof(*buf));
+
+    PMCPair pair = { .v1 = v1, .v2 = v2 };
+    assert(arll_push(&stack, &pair) != -1);
+    while (!arll_pop(&stack, &pair)) {
+        if (pair.v1 == PMCV_nil) {
+            assert(pair.v2 == PMCV_nil);
+            continue;
+        }
+        v1 = pair.v1;
+        v2 = pair.v2;
+        assert(PMCV_type(cp, v1) == PMCV_type(cp, v2));
+        assert(PMVG_merge(PMCV_vp(cp, v1)->gp, PMCV_vp(cp, v2)->gp) == 0);
+
+        PMCPair next[3] = {
+            { PMCV_np(cp, v1), PMCV_np(cp, v2) },
+            { PMCV_b2(cp, v1), PMCV_b2(cp, v2) },
+            { PMCV_b1(cp, v1), PMCV_b1(cp, v2) }
+        };
+        for (unsigned i = 0; i < 3; i++)
+            assert(arll_push(&stack, &next[i]) != -1);
+    }
+    arll_deinit(&stack);
+}
@@ -0,0 +1,100 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef PM_COMPACT_H_
+#define PM_COMPACT_H_
+
+#include <stdint.h>
+#include "pm.h"
+#include "arll.h"
+
+/* Compact store of a PPM tree without wrappers, for the miners. The vertices
+ * are those of the frozen layout of the tree (see PMContext_layout()), in the
+ * order PMV_walk() visits them, addressed by the same 32-bit handles and
+ * linked the same way. Without wrappers, the class of a tree tells its
+ * similarity (see PMV.cls): the classes and the symmetry of the
+ * inosculations are copied from the tree into parallel columns, and the
+ * comparisons only read these.
+ *
+ * The layout is owned by the PM context, which drops it when the tree
+ * structure changes: the store has to be destroyed before that, e.g. before
+ * GM_mine_recurrence(). Group merges leave it as it is, since the groups are
+ * reached through the vertices of the tree. */
+
+/* vertex handle, an index of the frozen layout */
+typedef PMFV PMCV;
+#define PMCV_nil PMFV_nil
+
+/* flags column */
+#define PMCV_F_INSC_is_sym 0x01
+
+typedef struct {
+    PMContext *ctx;
+    /* the frozen layout of the tree: order, types, links and vertices */
+    const PMFrozen *fzp;
+    /* number of vertices */
+    uint32_t cnt;
+    /* PMCV_F_* flags */
+    uint8_t *flags;
+    /* classes of the trees, see PMV.cls */
+    uint32_t *cls;
+} PMCompact;
+
+PMCompact *PMCompact_create(PMContext *ctx);
+void PMCompact_destroy(PMCompact *cp);
+int PMCV_is_similar(const PMCompact *cp, PMCV v1, PMCV v2);
+void PMCV_merge(PMCompact *cp, PMCV v1, PMCV v2);
+
+/* @return the type of a vertex, see PMVType */
+static inline PMVType PMCV_type(const PMCompact *cp, PMCV v)
+{
+    return cp->fzp->shape[v] & PMFZ_TYPE;
+}
+
+/* @return the next vertex of a vertex, PMCV_nil if none */
+static inline PMCV PMCV_np(const PMCompact *cp, PMCV v)
+{
+    return PMFrozen_np(cp->fzp, v);
+}
+
+/* @return the first branch (parent or wrapped) of a vertex, PMCV_nil if
+ *  none */
+static inline PMCV PMCV_b1(const PMCompact *cp, PMCV v)
+{
+    return PMFrozen_b1(cp->fzp, v);
+}
+
+/* @return the child branch of a vertex, PMCV_nil if none */
+static inline PMCV PMCV_b2(const PMCompact *cp, PMCV v)
+{
+    return PMFrozen_b2(cp->fzp, v);
+}
+
+/* @return the vertex of the tree */
+static inline PMV *PMCV_vp(const PMCompact *cp, PMCV v)
+{
+    return cp->fzp->vpl[v];
+}
+
+/* @return the root of the tree, PMCV_nil if empty */
+static inline PMCV PMCompact_root(const PMCompact *cp)
+{
+    assert(cp);
+    return cp->cnt ? 0 : PMCV_nil;
+}
+
+#endif /* PM_COMPACT_H_ */
@@ -201,7 +201,8 @@ static void _export_plot(
  * segments. One dictionary is created for each cluster.The raw segments are not 
  * removed from their segment context.
  * @param clctx pointer to the segment cluster context
- * @param tsrctx pointer to the TaskSegRaw context
+ * @param tsrctx pointer to the TaskSegRaw context, whose options are used for
+ *  the merged segments of the clusters
  * @param tsbctx pointer to the TaskSegBuck context
  * @param dctx pointer to the dictionary context */
 void SegClusterCtx_compress(
@@ -210,13 +211,21 @@ void SegClusterCtx_compress(
     TaskSegBuckCtx *tsbctx,
     TCDictCtx *dctx)
 {
-    assert(clctx);
+    assert(clctx && tsrctx);
     SegCluster *clp;
 
+    /* the merged segments only live for their cluster, their task lists are
+     * kept apart from the ones of the model and released on return */
+    TaskSegRawCtx evalctx;
+    assert(!TaskSegRawCtx_init(
+        &evalctx,
+        tsrctx->compopt.mu_max,
+        tsrctx->compopt.sigma_max));
+
     arll_rewind(clctx->cluster_arll);
     while((clp = arll_next(clctx->cluster_arll))) {
         TaskSegRaw *eval_seg = _obj_alloc(sizeof(TaskSegRaw));
-        assert(!TaskSegRaw_init(tsrctx, eval_seg));
+        assert(!TaskSegRaw_init(&evalctx, eval_seg));
 
         PMV **vpp;
         arll_rewind(clp->segv_arll);
@@ -275,6 +284,8 @@ void SegClusterCtx_compress(
         Object_deinit((Object*)eval_seg);
         free(eval_seg);
     }
+
+    Object_deinit((Object*)&evalctx);
 }
 
 /* For all the clusters in the context, replaces the segments of the vertices in
@@ -0,0 +1,137 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "slab.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+static const slab slab_zero = { 0 };
+
+/* the chunk header only holds the link to the next chunk, but keeps the
+ * objects aligned */
+#define SLAB_ALIGN      alignof(max_align_t)
+#define SLAB_HDR_SIZ    SLAB_ALIGN
+
+/* Allocate a slab allocator.
+ * @param obj_siz size of the objects
+ * @param chunk_objcnt number of objects per chunk
+ * @return pointer to the slab object on success, NULL on failure */
+slab *slab_construct(size_t obj_siz, unsigned chunk_objcnt)
+{
+    assert(obj_siz && chunk_objcnt);
+    slab *sp = malloc(sizeof(*sp));
+    if (!sp) return NULL;
+    *sp = slab_zero;
+
+    /* room for the free list link, and aligned */
+    if (obj_siz < sizeof(void*)) obj_siz = sizeof(void*);
+    sp->obj_siz = (obj_siz + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+    sp->chunk_objcnt = chunk_objcnt;
+
+    return sp;
+}
+
+/* @return pointer to a zeroed object, NULL on memory allocation failure
+ * @param sp pointer to the slab object */
+void *slab_alloc(slab *sp)
+{
+    assert(sp);
+    void *objp;
+
+    if (sp->free_l) {
+        objp = sp->free_l;
+        sp->free_l = *(void**)objp;
+    } else {
+        if (sp->cur == sp->end) {
+            char *chunk = malloc(SLAB_HDR_SIZ + sp->obj_siz * sp->chunk_objcnt);
+            if (!chunk) return NULL;
+            *(void**)chunk = sp->chunk_l;
+            sp->chunk_l = chunk;
+            sp->chunk_cnt++;
+            sp->cur = chunk + SLAB_HDR_SIZ;
+            sp->end = sp->cur + sp->obj_siz * sp->chunk_objcnt;
+        }
+        objp = sp->cur;
+        sp->cur += sp->obj_siz;
+    }
+
+    memset(objp, 0, sp->obj_siz);
+    return objp;
+}
+
+/* Release an object for reuse by slab_alloc().
+ * @param sp pointer to the slab object
+ * @param objp pointer to an object allocated from 'sp', can be NULL */
+void slab_free(slab *sp, void *objp)
+{
+    assert(sp);
+    if (!objp) return;
+    *(void**)objp = sp->free_l;
+    sp->free_l = objp;
+}
+
+/* Move the chunks and the released objects of 'from' into 'to', e.g. once
+ * objects were allocated from a slab private to a thread. The objects stay
+ * where they are, and are released with 'to'. 'from' is left empty.
+ * @param to pointer to the slab object taking over the objects
+ * @param from pointer to a slab object of the same object size */
+void slab_absorb(slab *to, slab *from)
+{
+    assert(to && from);
+    assert(to->obj_siz == from->obj_siz);
+
+    /* the current chunk of 'to' stays in use, the other ones are linked
+     * behind it */
+    if (from->chunk_l) {
+        void **lastpp = from->chunk_l;
+        while (*lastpp) lastpp = *lastpp;
+        if (to->chunk_l) {
+            *lastpp = *(void**)to->chunk_l;
+            *(void**)to->chunk_l = from->chunk_l;
+        } else {
+            to->chunk_l = from->chunk_l;
+        }
+        to->chunk_cnt += from->chunk_cnt;
+    }
+
+    /* the space left in the current chunk of 'from' is lost */
+    if (from->free_l) {
+        void **lastpp = from->free_l;
+        while (*lastpp) lastpp = *lastpp;
+        *lastpp = to->free_l;
+        to->free_l = from->free_l;
+    }
+
+    from->chunk_l = from->free_l = NULL;
+    from->cur = from->end = NULL;
+    from->chunk_cnt = 0;
+}
+
+/* Destroy a slab object, releasing all its objects at once.
+ * @param sp pointer to the slab object */
+void slab_destroy(slab *sp)
+{
+    if (!sp) return;
+    while (sp->chunk_l) {
+        void *next = *(void**)sp->chunk_l;
+        free(sp->chunk_l);
+        sp->chunk_l = next;
+    }
+    free(sp);
+}
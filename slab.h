@@ -0,0 +1,47 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stddef.h>
+
+/* Slab allocator for objects of fixed size. Objects are carved from large
+ * chunks, and released objects are recycled. All the objects are released at
+ * once by slab_destroy(). */
+
+typedef struct {
+    /* released objects, linked through their first bytes */
+    void            *free_l;
+    /* chunks, linked through their first bytes */
+    void            *chunk_l;
+    /* free space of the current chunk */
+    char            *cur;
+    char            *end;
+    size_t          obj_siz;
+    unsigned        chunk_objcnt;
+    /* number of chunks allocated */
+    unsigned long   chunk_cnt;
+} slab;
+
+slab    *slab_construct(size_t obj_siz, unsigned chunk_objcnt);
+void    *slab_alloc(slab *sp);
+void    slab_free(slab *sp, void *objp);
+void    slab_absorb(slab *to, slab *from);
+void    slab_destroy(slab *sp);
+
+#endif /* SLAB_H_ */
@@ -0,0 +1,70 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Converts a PPM model file from the text format to the binary format, which
+ * MParser_parse_mmap() loads much faster. The input may be gzip or zstd
+ * compressed.
+ *
+ * usage: model2bin <model.txt> <model.bin> */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "../inc/PPM_tools.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        printf("usage: %s <model.txt> <model.bin>\n", argv[0]);
+        return -1;
+    }
+
+    FILE *inputf = fopen(argv[1], "r");
+    if (!inputf) {
+        printf("Error opening input file %s\n", argv[1]);
+        return -1;
+    }
+
+    /* The task numbers are kept as they are, whatever their range. */
+    MParser parser_ctx;
+    int retval = MParser_init_stream(&parser_ctx, inputf, -1, -1);
+    if (retval == MP_ok) {
+        parser_ctx.flags = MPF_sparse;
+        retval = MParser_parse_stream(&parser_ctx);
+    }
+    if (retval != MP_ok) {
+        printf("Model parser: parsing failed with code %d, line %lu.\n",
+            retval, parser_ctx.err_lno);
+        return -1;
+    }
+    fclose(inputf);
+
+    FILE *outputf = fopen(argv[2], "wb");
+    if (!outputf) {
+        printf("Error opening output file %s\n", argv[2]);
+        return -1;
+    }
+    retval = MParser_export_bin(&parser_ctx, outputf);
+    if (fclose(outputf)) retval = MP_err;
+    if (retval != MP_ok) {
+        printf("Model parser: export failed with code %d.\n", retval);
+        return -1;
+    }
+    printf("Model parser: %s converted to %s.\n", argv[1], argv[2]);
+
+    MParser_deinit(&parser_ctx);
+    return 0;
+}
@@ -0,0 +1,199 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+/* Parse-only benchmark of the model parser. Parses a model file 'repeats'
+ * times with one parsing mode and prints the best time and throughput. The
+ * PPM is not built. Mode 'sscanf' is a reference scanner with the sscanf()
+ * formats the parser used before its hand-written tokenizer, it decodes the
+ * tasks without storing them.
+ *
+ * usage: parse_bench <model.txt> [mode] [repeats]
+ *  mode: fgets, mmap, mt<N>, stream, bin or sscanf, default mmap. Prefix
+ *        's:' for MPF_sparse, 'c:' for MPF_columnar, e.g. 'c:s:mt4'. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "../inc/PPM_tools.h"
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Reference scanner, the line formats of the former sscanf() parser.
+ * @return number of tasks read, or -1 on a corrupt line */
+static long _parse_sscanf(FILE *src)
+{
+    char linebuf[256];
+    long cnt = 0;
+
+    while (fgets(linebuf, sizeof(linebuf), src)) {
+        unsigned long tno;
+        MPTask ct = {0};
+        int lp, conv_cnt;
+
+        if (linebuf[0] < '0' || linebuf[0] > '9') continue;
+
+        conv_cnt = sscanf(linebuf, "%lu %d %d %lu%n",
+            &tno, &ct.pno, (int*)&ct.ttype, &ct.mem, &lp);
+        if (conv_cnt != 4) return -1;
+
+        switch (ct.ttype) {
+        case MPTT_start:
+        case MPTT_forkend:
+        case MPTT_join:
+            conv_cnt = sscanf(linebuf + lp, " -> %lu", &ct.next[0]) - 1;
+            break;
+        case MPTT_end:
+            conv_cnt = 0;
+            break;
+        case MPTT_fork:
+            /* the second branch is optional, empty fork */
+            conv_cnt = sscanf(linebuf + lp, " -> %lu %*u %*u -> %lu",
+                &ct.next[0], &ct.next[1]) < 1 ? -1 : 0;
+            break;
+        case MPTT_calc:
+            conv_cnt = sscanf(linebuf + lp, " %lf -> %lu",
+                &ct.req, &ct.next[0]) - 2;
+            break;
+        case MPTT_com: {
+            int lpt;
+            conv_cnt = sscanf(linebuf + lp, " %lf -- %lu%n",
+                &ct.req, &ct.dest, &lpt) - 2;
+            if (conv_cnt) break;
+            /* dest == 0 => broadcast */
+            conv_cnt = sscanf(linebuf + lp + lpt,
+                ct.dest == 0 ? " -> %lu" : "  %*u %*u -> %lu",
+                &ct.next[0]) - 1;
+            break;
+        }
+        default:
+            conv_cnt = -1;
+        }
+        if (conv_cnt) return -1;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+/* Parse the model once
+ * @return parsing time in seconds, or a negative value on failure */
+static double _parse_once(const char *fname, const char *mode,
+    unsigned flags, unsigned long *task_cnt)
+{
+    MParser ctx;
+    FILE *src = NULL;
+    MPRes res;
+    double t0;
+
+    if (!strcmp(mode, "sscanf")) {
+        long cnt;
+        if (!(src = fopen(fname, "r"))) return -1.0;
+        t0 = _now();
+        cnt = _parse_sscanf(src);
+        t0 = _now() - t0;
+        fclose(src);
+        *task_cnt = cnt;
+        return cnt < 0 ? -1.0 : t0;
+    }
+
+    if (!strcmp(mode, "fgets") || !strcmp(mode, "stream")) {
+        if (!(src = fopen(fname, "r"))) return -1.0;
+        res = mode[0] == 'f' ?
+            MParser_init(&ctx, src, -1, -1) :
+            MParser_init_stream(&ctx, src, -1, -1);
+    } else {
+        res = MParser_init_mmap(&ctx, fname, -1, -1);
+    }
+    if (res != MP_ok) {
+        if (src) fclose(src);
+        return -1.0;
+    }
+    ctx.flags = flags;
+
+    t0 = _now();
+    if (!strcmp(mode, "fgets"))
+        res = MParser_parse(&ctx);
+    else if (!strcmp(mode, "stream"))
+        res = MParser_parse_stream(&ctx);
+    else if (!strcmp(mode, "mmap"))
+        res = MParser_parse_mmap(&ctx);
+    else if (!strcmp(mode, "bin"))
+        res = MParser_parse_bin(&ctx);
+    else if (!strncmp(mode, "mt", 2) && atoi(mode + 2) > 0)
+        res = MParser_parse_mmap_mt(&ctx, atoi(mode + 2));
+    else
+        res = MP_err;
+    t0 = _now() - t0;
+
+    if (res != MP_ok)
+        printf("Model parser: parsing failed with code %d, line %lu.\n",
+            res, ctx.err_lno);
+    *task_cnt = ctx.task_llen;
+    MParser_deinit(&ctx);
+    if (src) fclose(src);
+    return res == MP_ok ? t0 : -1.0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 4) {
+        printf("usage: %s <model.txt> [mode] [repeats]\n", argv[0]);
+        return -1;
+    }
+
+    const char *mode_name = argc > 2 ? argv[2] : "mmap";
+    const char *mode = mode_name;
+    int repeats = argc > 3 ? atoi(argv[3]) : 5;
+    unsigned flags = 0;
+    struct stat st;
+
+    for (;;) {
+        if (!strncmp(mode, "s:", 2)) flags |= MPF_sparse;
+        else if (!strncmp(mode, "c:", 2)) flags |= MPF_columnar;
+        else break;
+        mode += 2;
+    }
+    if (repeats < 1) repeats = 1;
+
+    if (stat(argv[1], &st)) {
+        printf("Error opening input file %s\n", argv[1]);
+        return -1;
+    }
+
+    double best = 0.0;
+    unsigned long task_cnt = 0;
+    for (int r = 0; r < repeats; r++) {
+        double sec = _parse_once(argv[1], mode, flags, &task_cnt);
+        if (sec < 0.0) {
+            printf("Error parsing %s in mode %s\n", argv[1], mode_name);
+            return -1;
+        }
+        if (!r || sec < best) best = sec;
+    }
+
+    printf("%s: %s, %lu tasks, %.1f MB, best of %d: %.3f s, %.1f MB/s\n",
+        argv[1], mode_name, task_cnt, st.st_size / 1e6,
+        repeats, best, best > 0.0 ? st.st_size / best / 1e6 : 0.0);
+    return 0;
+}
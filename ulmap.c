@@ -0,0 +1,182 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#include "ulmap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Each slot holds the key plus one, zero marking an empty slot, followed by
+ * the value. */
+typedef unsigned long ulmap_key;
+
+static const ulmap ulmap_zero = { 0 };
+
+#define ULMAP_SLOT(__mapp, __i) \
+    ((ulmap_key*)((char*)(__mapp)->slot_l + (size_t)(__i) * (__mapp)->slot_siz))
+
+static inline unsigned long _home(const ulmap *mapp, unsigned long key)
+{
+    /* Fibonacci hashing, slot_cnt is a power of two */
+    return (uint64_t)key * 0x9E3779B97F4A7C15ULL >>
+        (64 - __builtin_ctzl(mapp->slot_cnt));
+}
+
+/* @return index of the slot holding 'key', or of the empty slot where it
+ * would be inserted */
+static inline unsigned long _find(const ulmap *mapp, unsigned long key)
+{
+    unsigned long mask = mapp->slot_cnt - 1;
+    unsigned long i = _home(mapp, key);
+    ulmap_key sk;
+
+    while ((sk = *ULMAP_SLOT(mapp, i)) && sk != key + 1)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int _rehash(ulmap *mapp, unsigned long slot_cnt)
+{
+    ulmap old = *mapp;
+
+    mapp->slot_l = calloc(slot_cnt, mapp->slot_siz);
+    if (!mapp->slot_l) {
+        *mapp = old;
+        return -1;
+    }
+    mapp->slot_cnt = slot_cnt;
+
+    for (unsigned long i = 0; i < old.slot_cnt; i++) {
+        ulmap_key *skp = ULMAP_SLOT(&old, i);
+        if (!*skp) continue;
+        memcpy(ULMAP_SLOT(mapp, _find(mapp, *skp - 1)), skp, mapp->slot_siz);
+    }
+
+    free(old.slot_l);
+    return 0;
+}
+
+/* Allocates memory for a hash map object and initializes it.
+ * @param val_siz size of the values stored in the map
+ * @param init_cnt number of entries the map can hold before growing
+ * @return pointer to the map object on success, NULL on failure */
+ulmap *ulmap_construct(uint16_t val_siz, unsigned long init_cnt)
+{
+    assert(val_siz);
+    ulmap *mapp = malloc(sizeof(*mapp));
+    if (!mapp) return NULL;
+    *mapp = ulmap_zero;
+
+    /* values aligned as the keys */
+    mapp->val_siz = val_siz;
+    mapp->slot_siz = sizeof(ulmap_key) +
+        (val_siz + sizeof(ulmap_key) - 1) / sizeof(ulmap_key) *
+        sizeof(ulmap_key);
+
+    unsigned long slot_cnt = 16;
+    while (slot_cnt / 2 < init_cnt) slot_cnt *= 2;
+    if (_rehash(mapp, slot_cnt)) {
+        free(mapp);
+        return NULL;
+    }
+
+    return mapp;
+}
+
+/* @param mapp pointer to the map object
+ * @param key key to look up
+ * @return pointer to the value stored for 'key', NULL if there is none.
+ * WARNING: returned pointer not guaranteed to be valid after a call to
+ * ulmap_put() or ulmap_del() on the same map object. */
+void *ulmap_get(const ulmap *mapp, unsigned long key)
+{
+    assert(mapp);
+    ulmap_key *skp = ULMAP_SLOT(mapp, _find(mapp, key));
+    return *skp ? skp + 1 : NULL;
+}
+
+/* Insert 'key' in the map, unless already there.
+ * @param mapp pointer to the map object
+ * @param key key to be inserted
+ * @return pointer to the value stored for 'key', zeroed if newly inserted, or
+ *  NULL on memory allocation failure. WARNING: returned pointer not
+ *  guaranteed to be valid after a call to ulmap_put() or ulmap_del() on the
+ *  same map object. */
+void *ulmap_put(ulmap *mapp, unsigned long key)
+{
+    assert(mapp && key != (unsigned long)-1);
+
+    ulmap_key *skp = ULMAP_SLOT(mapp, _find(mapp, key));
+    if (*skp) return skp + 1;
+
+    /* keep the load factor under 1/2 */
+    if ((mapp->len + 1) * 2 > mapp->slot_cnt) {
+        if (_rehash(mapp, mapp->slot_cnt * 2)) return NULL;
+        skp = ULMAP_SLOT(mapp, _find(mapp, key));
+    }
+
+    *skp = key + 1;
+    memset(skp + 1, 0, mapp->val_siz);
+    mapp->len++;
+    return skp + 1;
+}
+
+/* Remove 'key' from the map. The entries following it in the probing
+ * sequence are shifted back, so no deletion markers are left behind.
+ * @param mapp pointer to the map object
+ * @param key key to be removed
+ * @return 0 on success, -1 if 'key' is not in the map */
+int ulmap_del(ulmap *mapp, unsigned long key)
+{
+    assert(mapp);
+    unsigned long mask = mapp->slot_cnt - 1;
+    unsigned long i = _find(mapp, key);
+    ulmap_key *skp;
+
+    if (!*ULMAP_SLOT(mapp, i)) return -1;
+
+    for (unsigned long j = (i + 1) & mask; *(skp = ULMAP_SLOT(mapp, j));
+         j = (j + 1) & mask) {
+        /* the entry can fill the gap if it does not land before its home */
+        unsigned long home = _home(mapp, *skp - 1);
+        if (((j - home) & mask) < ((j - i) & mask)) continue;
+        memcpy(ULMAP_SLOT(mapp, i), skp, mapp->slot_siz);
+        i = j;
+    }
+
+    *ULMAP_SLOT(mapp, i) = 0;
+    mapp->len--;
+    return 0;
+}
+
+/* @return number of entries stored in the map object
+ * @param mapp pointer to the map object */
+unsigned long ulmap_len(const ulmap *mapp)
+{
+    assert(mapp);
+    return mapp->len;
+}
+
+/* Destroys a map object and frees the memory associated with it.
+ * @param mapp pointer to the map object to be destroyed */
+void ulmap_destroy(ulmap *mapp)
+{
+    if (mapp) {
+        free(mapp->slot_l);
+        free(mapp);
+    }
+}
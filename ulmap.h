@@ -0,0 +1,41 @@
+/* This file is part of the 'PPM tools' PPM compression library.
+ * Copyright (C) 2020  Mihai Renea
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * */
+
+#ifndef ULMAP_H_
+#define ULMAP_H_
+
+#include <stdint.h>
+
+/* Hash map with unsigned long keys, open addressing with linear probing.
+ * Only for values of fixed size. The key ULONG_MAX is reserved. */
+
+typedef struct {
+    void            *slot_l;
+    unsigned long   slot_cnt;
+    unsigned long   len;
+    uint16_t        val_siz;
+    uint16_t        slot_siz;
+} ulmap;
+
+ulmap           *ulmap_construct(uint16_t val_siz, unsigned long init_cnt);
+void            *ulmap_get(const ulmap *mapp, unsigned long key);
+void            *ulmap_put(ulmap *mapp, unsigned long key);
+int             ulmap_del(ulmap *mapp, unsigned long key);
+unsigned long   ulmap_len(const ulmap *mapp);
+void            ulmap_destroy(ulmap *mapp);
+
+#endif /* ULMAP_H_ */